@@ -1,7 +1,7 @@
-
 /////   INCLUDES   /////
 
 #include "advanced_help.h"
+#include "advanced_help_internal.h"
 
 
 
@@ -15,10 +15,13 @@ char* saved_orig_locale = NULL;
 
 /////   FUNCTION DEFINITIONS   /////
 
-char* getLineNode(_In_ char* new_line, _In_opt_ char* current_node);
-WCHAR* getLineNodeW(_In_ WCHAR* new_line, _In_opt_ WCHAR* current_node);
-size_t getNodeLevel(_In_ const char* current_node);
-size_t getNodeLevelW(_In_ const WCHAR* current_node);
+int buildAdvancedHelpNodeTable(_Inout_ AdvancedHelp* help);
+int buildAdvancedHelpNodeTableW(_Inout_ AdvancedHelp* help);
+int growAdvancedHelpMatchState(_Inout_ AdvancedHelpMatchState* state, _In_ size_t min_capacity);
+int growAdvancedHelpMatchStateW(_Inout_ AdvancedHelpMatchStateW* state, _In_ size_t min_capacity);
+
+static __forceinline bool getNextNodeKernel(_Inout_ AdvancedHelpNodeIterator* iterator, _Out_ AdvancedHelpNodeRef* node, _In_ const char node_level_char, _In_ const char node_start_char);
+static __forceinline bool getNextNodeKernelW(_Inout_ AdvancedHelpNodeIteratorW* iterator, _Out_ AdvancedHelpNodeRefW* node, _In_ const WCHAR node_level_char, _In_ const WCHAR node_start_char);
 
 
 
@@ -29,502 +32,729 @@ size_t getNodeLevelW(_In_ const WCHAR* current_node);
 // The returned pointer must be freed by function caller
 char* getAdvancedHelpForKeyword(_In_ const char* keyword, _In_ void* help_ptr) {
 	char* help_to_show = NULL;
-	char* full_help_text = NULL;
-	char* current_nodes[MAX_NODE_LEVEL] = { 0 };
-	bool current_nodes_already_included[MAX_NODE_LEVEL] = { 0 };
-
-	if (NULL == help_ptr) {
-		goto HELP_UNINITIALIZED_ERROR_LABEL;
-	}
-
-	full_help_text = (char*)malloc(strlen((char*)help_ptr) + 1);
-	if (NULL == full_help_text) {
-		goto HELP_NOMEM_ERROR_LABEL;
-	}
-	strcpy_s(full_help_text, strlen((char*)help_ptr) + 1, (char*)help_ptr);
-
-	// Init arrays
-	for (size_t i = 0; i < MAX_NODE_LEVEL; i++) {
-		current_nodes[i] = NULL;
-		current_nodes_already_included[i] = false;
+	AdvancedHelpStatus status = getAdvancedHelpForKeywordEx(keyword, help_ptr, &help_to_show, NULL, NULL);
+	if (ADVANCED_HELP_STATUS_OK == status) {
+		return help_to_show;
 	}
+	// Try to copy the error description as output
+	return copyAdvancedHelpStatusMessage(status);
+}
 
-	if (0 == strcmp("", keyword)) {
-		return full_help_text;
+WCHAR* getAdvancedHelpForKeywordW(_In_ const WCHAR* keyword, _In_ void* help_ptr) {
+	WCHAR* help_to_show = NULL;
+	AdvancedHelpStatus status = getAdvancedHelpForKeywordExW(keyword, help_ptr, &help_to_show, NULL, NULL);
+	if (ADVANCED_HELP_STATUS_OK == status) {
+		return help_to_show;
 	}
+	// Try to copy the error description as output
+	return copyAdvancedHelpStatusMessageW(status);
+}
 
-	// Nodes are the same as lines, but without the NODE_START_CHAR if needed. No memory is allocated for lines nor nodes
-	char* line = NULL;
-	char* current_node = NULL;
-	char* new_node = NULL;
-	size_t current_node_level = 0;
-	size_t forced_include_min_level = MAX_NODE_LEVEL;
-
-	// Process all the help iteratively line by line
-	// Note:
-	//    When there are no more tokens, line becomes NULL, new_node becomes NULL too, and it will be different from current_node.
-	//    Then the last node is processed.
-	//    Finally, current_node is assigned to new_node (=NULL), allowing the loop to exit
-	int iteration = 0;
-	char* strtok_ctx = NULL;
-	do {
-		iteration++;
-		//printf("\n\niteration %d\n", iteration);
+// Same as getAdvancedHelpForKeyword(), but the outcome is returned as a status instead of as a message in the result.
+// *result_ptr is only set (and must be freed by function caller) if ADVANCED_HELP_STATUS_OK is returned, so misses and errors do not allocate any memory.
+// If the help is incorrectly formatted, error_info gets the line and level of the node causing the error
+AdvancedHelpStatus getAdvancedHelpForKeywordEx(_In_ const char* keyword, _In_ void* help_ptr, _Out_ char** result_ptr, _Out_opt_ size_t* result_len, _Out_opt_ AdvancedHelpErrorInfo* error_info) {
+	return queryAdvancedHelp(keyword, help_ptr, result_ptr, result_len, error_info, NULL);
+}
 
-		if (NULL == line) {
-			line = strtok_s(full_help_text, "\n", &strtok_ctx);
-		} else {
-			line = strtok_s(NULL, "\n", &strtok_ctx);
+// Body of getAdvancedHelpForKeywordEx(). If cancelled is not NULL, the search stops with ADVANCED_HELP_STATUS_CANCELLED as soon as it is set (it is checked before every node)
+AdvancedHelpStatus queryAdvancedHelp(_In_ const char* keyword, _In_ void* help_ptr, _Out_ char** result_ptr, _Out_opt_ size_t* result_len, _Out_opt_ AdvancedHelpErrorInfo* error_info, _In_opt_ const volatile LONG* cancelled) {
+	const AdvancedHelp* help = (const AdvancedHelp*)help_ptr;
+	AdvancedHelpBuffer help_to_show = { 0 };
+	AdvancedHelpMatchState state;
+	AdvancedHelpStatus status = ADVANCED_HELP_STATUS_OK;
+	AdvancedHelpStatsRecord stats_record;
+	beginAdvancedHelpQueryStats(&stats_record);
+
+	*result_ptr = NULL;
+	if (NULL != result_len) {
+		*result_len = 0;
+	}
+	if (NULL != error_info) {
+		error_info->line = 0;
+		error_info->level = 0;
+	}
+
+	if (NULL == help || help->is_wide) {
+		endAdvancedHelpQueryStats(&stats_record, ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR, 0, 0, 0);
+		return ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR;
+	}
+
+	initAdvancedHelpMatchState(&state, keyword, help->options.max_node_level);
+	if (NULL != help->snapshot && findAdvancedHelpSnapshotResult(help->snapshot, keyword, &status, &help_to_show, error_info)) {
+		// Precomputed in the snapshot file (see loadAdvancedHelpSnapshot)
+		countAdvancedHelpCacheHit();
+	} else if (0 == state.keyword_len) {
+		// The whole help is shown as it is
+		if (0 != appendToAdvancedHelpBuffer(&help_to_show, "", 0) || 0 != writeAdvancedHelpText(help, writeToAdvancedHelpBuffer, &help_to_show)) {
+			status = ADVANCED_HELP_STATUS_NOMEM_ERROR;
 		}
-		new_node = getLineNode(line, current_node);
-		//printf("  line:\n%s\n", line);
-		//printf("  current_node:\n%s\n", current_node);
-		//printf("  new_node:\n%s\n", new_node);
-
-		//If current_node is NULL, assign it to the first node and continue, because it is the first iteration
-		if (NULL == current_node) {
-			current_node = new_node;
-			continue;
+	} else {
+		size_t i = 0;
+		for (i = 0; i < help->node_count; i++) {
+			if (NULL != cancelled && 0 != *cancelled) {
+				status = ADVANCED_HELP_STATUS_CANCELLED;
+				break;
+			}
+			status = matchAdvancedHelpNode(&state, &ADVANCED_HELP_NODE(help, i), emitNodeToAdvancedHelpBuffer, &help_to_show);
+			if (ADVANCED_HELP_STATUS_OK != status) {
+				break;
+			}
+		}
+		if (ADVANCED_HELP_STATUS_FORMAT_ERROR == status && NULL != error_info) {
+			error_info->line = ADVANCED_HELP_NODE(help, i).line;
+			error_info->level = ADVANCED_HELP_NODE(help, i).level;
 		}
-		// If the node is the same, continue reading because more tokens may fuse into the same node.
-		if (new_node == current_node || NULL == current_node) {
-			continue;
+		if (ADVANCED_HELP_STATUS_OK == status && NULL == help_to_show.data) {
+			status = ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND;
 		}
-		//printf("  Proceed to processing...\n");
+	}
+	freeAdvancedHelpMatchState(&state);
+
+	if (ADVANCED_HELP_STATUS_OK != status) {
+		free(help_to_show.data);
+		endAdvancedHelpQueryStats(&stats_record, status, state.nodes_scanned, state.nodes_matched, 0);
+		return status;
+	}
+	*result_ptr = help_to_show.data;
+	if (NULL != result_len) {
+		*result_len = help_to_show.len;
+	}
+	endAdvancedHelpQueryStats(&stats_record, status, state.nodes_scanned, state.nodes_matched, help_to_show.len);
+	return status;
+}
 
-		// Process current node (already complete with all its lines)
-		current_node_level = getNodeLevel(current_node);
-		//printf("  current_node_level=%llu\n", current_node_level);
+AdvancedHelpStatus getAdvancedHelpForKeywordExW(_In_ const WCHAR* keyword, _In_ void* help_ptr, _Out_ WCHAR** result_ptr, _Out_opt_ size_t* result_len, _Out_opt_ AdvancedHelpErrorInfo* error_info) {
+	const AdvancedHelp* help = (const AdvancedHelp*)help_ptr;
+	AdvancedHelpBufferW help_to_show = { 0 };
+	AdvancedHelpMatchStateW state;
+	AdvancedHelpStatus status = ADVANCED_HELP_STATUS_OK;
+	AdvancedHelpStatsRecord stats_record;
+	beginAdvancedHelpQueryStats(&stats_record);
 
-		// Check that nodes do not skip levels (eg, a level 1 node followed by level 3 node without a level 2 node in between)
-		for (size_t i = 0; i < current_node_level; i++) {
-			if (NULL == current_nodes[i]) {
-				//printf("current_nodes[%llu]=NULL\n", i);
-				goto HELP_FORMAT_ERROR_LABEL;
-			}
-		}
+	*result_ptr = NULL;
+	if (NULL != result_len) {
+		*result_len = 0;
+	}
+	if (NULL != error_info) {
+		error_info->line = 0;
+		error_info->level = 0;
+	}
 
-		// Assign current node
-		current_nodes[current_node_level] = current_node;
-		current_nodes_already_included[current_node_level] = false;
+	if (NULL == help || !help->is_wide) {
+		endAdvancedHelpQueryStats(&stats_record, ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR, 0, 0, 0);
+		return ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR;
+	}
 
-		// Clear subnodes
-		for (size_t i = current_node_level + 1; i < MAX_NODE_LEVEL; i++) {
-			if (NULL == current_nodes[i]) {
+	initAdvancedHelpMatchStateW(&state, keyword, help->options.max_node_level);
+	if (0 == state.keyword_len) {
+		// The whole help is shown as it is
+		if (0 != appendToAdvancedHelpBufferW(&help_to_show, (const WCHAR*)help->text, help->text_len)) {
+			status = ADVANCED_HELP_STATUS_NOMEM_ERROR;
+		}
+	} else {
+		size_t i = 0;
+		for (i = 0; i < help->node_count; i++) {
+			status = matchAdvancedHelpNodeW(&state, &(help->nodes_w[i]), emitNodeToAdvancedHelpBufferW, &help_to_show);
+			if (ADVANCED_HELP_STATUS_OK != status) {
 				break;
 			}
-			current_nodes[i] = NULL;
-			current_nodes_already_included[i] = false;
 		}
-
-		// Check if this node is forced to be added (due to parent node included the keyword)
-		if (forced_include_min_level < current_node_level) {
-			if ((0 != strAppendRealloc(&help_to_show, current_node)) || (0 != strAppendRealloc(&help_to_show, "\n"))) {
-				goto HELP_NOMEM_ERROR_LABEL;
-			}
-		} else {
-			// Stop forcing to include
-			forced_include_min_level = MAX_NODE_LEVEL;
-
-			// Search the keyword in the node
-			if (NULL != strstr(current_node, keyword)) {	// Keyword found!
-				// Include parent nodes if not already included
-				for (size_t i = 0; i < current_node_level + 1; i++) {
-					if (!current_nodes_already_included[i]) {
-						if ((0 != strAppendRealloc(&help_to_show, current_nodes[i])) || (0 != strAppendRealloc(&help_to_show, "\n"))) {
-							goto HELP_NOMEM_ERROR_LABEL;
-						}
-						current_nodes_already_included[i] = true;
-					}
-				}
-
-				// Include current node (already done in the loop above?)
-				//if ((0 != strAppendRealloc(&help_to_show, current_node)) || (0 != strAppendRealloc(&help_to_show, "\n"))) {
-				//	goto HELP_NOMEM_ERROR_LABEL;
-				//}
-				//current_nodes_already_included[current_node_level] = true;
-
-				// Force include everything below this level
-				forced_include_min_level = current_node_level;
-			}
+		if (ADVANCED_HELP_STATUS_FORMAT_ERROR == status && NULL != error_info) {
+			error_info->line = help->nodes_w[i].line;
+			error_info->level = help->nodes_w[i].level;
+		}
+		if (ADVANCED_HELP_STATUS_OK == status && NULL == help_to_show.data) {
+			status = ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND;
 		}
-
-		current_node = new_node;
-	} while (NULL != current_node);
-
-	// No errors
-	if (NULL == help_to_show) {
-		goto HELP_KEYWORD_NOT_FOUND_LABEL;
 	}
-	return help_to_show;
+	freeAdvancedHelpMatchStateW(&state);
 
-HELP_UNINITIALIZED_ERROR_LABEL:
-	if (NULL != help_to_show) {
-		free(help_to_show);
-		help_to_show = NULL;
+	if (ADVANCED_HELP_STATUS_OK != status) {
+		free(help_to_show.data);
+		endAdvancedHelpQueryStats(&stats_record, status, state.nodes_scanned, state.nodes_matched, 0);
+		return status;
 	}
-	if (NULL != full_help_text) {
-		free(full_help_text);
-		full_help_text = NULL;
+	*result_ptr = help_to_show.data;
+	if (NULL != result_len) {
+		*result_len = help_to_show.len;
 	}
-	// Try to copy the error description as output
-	help_to_show = (char*)malloc(strlen(ADVANCED_HELP_UNINITIALIZED_ERROR) + 1);
-	if (NULL == help_to_show) {
-		goto HELP_NOMEM_ERROR_LABEL;
-		//return NULL;	// Not even possible to output the error
-	}
-	strcpy_s(help_to_show, strlen(ADVANCED_HELP_UNINITIALIZED_ERROR) + 1, ADVANCED_HELP_UNINITIALIZED_ERROR);
-	return help_to_show;
+	endAdvancedHelpQueryStats(&stats_record, status, state.nodes_scanned, state.nodes_matched, sizeof(WCHAR) * help_to_show.len);
+	return status;
+}
 
+// Description of a status (the same messages returned by getAdvancedHelpForKeyword). No memory is allocated. Returns NULL for ADVANCED_HELP_STATUS_OK
+const char* getAdvancedHelpStatusMessage(_In_ AdvancedHelpStatus status) {
+	switch (status) {
+	case ADVANCED_HELP_STATUS_OK:
+		return NULL;
+	case ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND:
+		return ADVANCED_HELP_KEYWORD_NOT_FOUND_INFO;
+	case ADVANCED_HELP_STATUS_FORMAT_ERROR:
+		return ADVANCED_HELP_FORMAT_ERROR;
+	case ADVANCED_HELP_STATUS_NOMEM_ERROR:
+		return ADVANCED_HELP_NOMEM_ERROR;
+	case ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR:
+		return ADVANCED_HELP_UNINITIALIZED_ERROR;
+	case ADVANCED_HELP_STATUS_SINK_ERROR:
+		return ADVANCED_HELP_SINK_ERROR;
+	case ADVANCED_HELP_STATUS_CANCELLED:
+		return ADVANCED_HELP_CANCELLED_INFO;
+	default:
+		return NULL;
+	}
+}
 
-HELP_KEYWORD_NOT_FOUND_LABEL:
-	if (NULL != help_to_show) {
-		free(help_to_show);
-		help_to_show = NULL;
+const WCHAR* getAdvancedHelpStatusMessageW(_In_ AdvancedHelpStatus status) {
+	switch (status) {
+	case ADVANCED_HELP_STATUS_OK:
+		return NULL;
+	case ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND:
+		return WTEXT(ADVANCED_HELP_KEYWORD_NOT_FOUND_INFO);
+	case ADVANCED_HELP_STATUS_FORMAT_ERROR:
+		return WTEXT(ADVANCED_HELP_FORMAT_ERROR);
+	case ADVANCED_HELP_STATUS_NOMEM_ERROR:
+		return WTEXT(ADVANCED_HELP_NOMEM_ERROR);
+	case ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR:
+		return WTEXT(ADVANCED_HELP_UNINITIALIZED_ERROR);
+	case ADVANCED_HELP_STATUS_SINK_ERROR:
+		return WTEXT(ADVANCED_HELP_SINK_ERROR);
+	case ADVANCED_HELP_STATUS_CANCELLED:
+		return WTEXT(ADVANCED_HELP_CANCELLED_INFO);
+	default:
+		return NULL;
 	}
-	if (NULL != full_help_text) {
-		free(full_help_text);
-		full_help_text = NULL;
+}
+
+// Returns a malloc'ed copy of the message of a status, the not enough memory message if the copy fails, or NULL if not even that could be copied
+char* copyAdvancedHelpStatusMessage(_In_ AdvancedHelpStatus status) {
+	const char* message = getAdvancedHelpStatusMessage(status);
+	char* copy = (NULL != message) ? copyAdvancedHelpMessage(message) : NULL;
+	if (NULL == copy && ADVANCED_HELP_STATUS_NOMEM_ERROR != status) {
+		copy = copyAdvancedHelpMessage(ADVANCED_HELP_NOMEM_ERROR);
 	}
-	// Try to copy the error description as output
-	help_to_show = (char*)malloc(strlen(ADVANCED_HELP_KEYWORD_NOT_FOUND_INFO) + 1);
-	if (NULL == help_to_show) {
-		goto HELP_NOMEM_ERROR_LABEL;
-		//return NULL;	// Not even possible to output the error
+	return copy;
+}
+
+WCHAR* copyAdvancedHelpStatusMessageW(_In_ AdvancedHelpStatus status) {
+	const WCHAR* message = getAdvancedHelpStatusMessageW(status);
+	WCHAR* copy = (NULL != message) ? copyAdvancedHelpMessageW(message) : NULL;
+	if (NULL == copy && ADVANCED_HELP_STATUS_NOMEM_ERROR != status) {
+		copy = copyAdvancedHelpMessageW(WTEXT(ADVANCED_HELP_NOMEM_ERROR));
 	}
-	strcpy_s(help_to_show, strlen(ADVANCED_HELP_KEYWORD_NOT_FOUND_INFO) + 1, ADVANCED_HELP_KEYWORD_NOT_FOUND_INFO);
-	return help_to_show;
+	return copy;
+}
 
+void initAdvancedHelpNodeIterator(_Out_ AdvancedHelpNodeIterator* iterator, _In_ const char* help_text, _In_ const AdvancedHelpOptions* options) {
+	iterator->pos = help_text;
+	iterator->line = 1;
+	iterator->first_node = true;
+	iterator->node_level_char = options->node_level_char;
+	iterator->node_start_char = options->node_start_char;
+}
 
-HELP_FORMAT_ERROR_LABEL:
-	if (NULL != help_to_show) {
-		free(help_to_show);
-		help_to_show = NULL;
-	}
-	if (NULL != full_help_text) {
-		free(full_help_text);
-		full_help_text = NULL;
+// Retrieves the next node of the help text. Returns false when there are no more nodes. The help text is left untouched:
+//    - Empty lines are skipped
+//    - The node start char is removed from every node but the first one
+//    - If the node start char is not null, the lines not starting with it are part of the previous node (the '\n' between them are kept)
+//    - The level is the number of node level chars in the whole node
+// The usual formats get their own copy of the kernel with the chars known at compile time. It only runs when the node table is built
+// (at init or when editing), queries walk the table
+bool getNextAdvancedHelpNode(_Inout_ AdvancedHelpNodeIterator* iterator, _Out_ AdvancedHelpNodeRef* node) {
+	if ('\t' == iterator->node_level_char && '\0' == iterator->node_start_char) {
+		return getNextNodeKernel(iterator, node, '\t', '\0');
+	}
+#if NODE_LEVEL_CHAR != '\t' || NODE_START_CHAR != '\0'
+	if (NODE_LEVEL_CHAR == iterator->node_level_char && NODE_START_CHAR == iterator->node_start_char) {
+		return getNextNodeKernel(iterator, node, NODE_LEVEL_CHAR, NODE_START_CHAR);
+	}
+#endif
+	return getNextNodeKernel(iterator, node, iterator->node_level_char, iterator->node_start_char);
+}
+
+// Body of getNextAdvancedHelpNode(). Always inlined, so the calls with constant chars are compiled as specialized kernels
+static __forceinline bool getNextNodeKernel(_Inout_ AdvancedHelpNodeIterator* iterator, _Out_ AdvancedHelpNodeRef* node, _In_ const char node_level_char, _In_ const char node_start_char) {
+	const char* line = iterator->pos;
+	size_t line_number = iterator->line;
+	while ('\n' == *line) {
+		line++;
+		line_number++;
+	}
+	if ('\0' == *line) {
+		iterator->pos = line;
+		iterator->line = line_number;
+		return false;
+	}
+
+	const char* node_text = line;
+	size_t node_line_number = line_number;
+	if ('\0' != node_start_char && !iterator->first_node && node_start_char == *line) {
+		node_text++;
+	}
+
+	const char* node_end = strchr(line, '\n');
+	if (NULL == node_end) {
+		node_end = line + strlen(line);
+	}
+	if ('\0' != node_start_char) {
+		// Append the following lines until a new node starts
+		const char* next_line = node_end;
+		size_t next_line_number = line_number;
+		while (true) {
+			while ('\n' == *next_line) {
+				next_line++;
+				next_line_number++;
+			}
+			if ('\0' == *next_line || node_start_char == *next_line) {
+				break;
+			}
+			line_number = next_line_number;
+			node_end = strchr(next_line, '\n');
+			if (NULL == node_end) {
+				node_end = next_line + strlen(next_line);
+			}
+			next_line = node_end;
+		}
 	}
-	// Try to copy the error description as output
-	help_to_show = (char*)malloc(strlen(ADVANCED_HELP_FORMAT_ERROR) + 1);
-	if (NULL == help_to_show) {
-		goto HELP_NOMEM_ERROR_LABEL;
-		//return NULL;	// Not even possible to output the error
+	iterator->pos = node_end;
+	iterator->line = line_number;
+	iterator->first_node = false;
+
+	node->text = node_text;
+	node->len = (size_t)(node_end - node_text);
+	node->line = node_line_number;
+	node->level = 0;
+	for (const char* c = node_text; c < node_end; c++) {
+		if (node_level_char == *c) {
+			node->level++;
+		}
 	}
-	strcpy_s(help_to_show, strlen(ADVANCED_HELP_FORMAT_ERROR) + 1, ADVANCED_HELP_FORMAT_ERROR);
-	return help_to_show;
+	return true;
+}
 
+void initAdvancedHelpMatchState(_Out_ AdvancedHelpMatchState* state, _In_ const char* keyword, _In_ size_t max_node_level) {
+	state->keyword = keyword;
+	state->keyword_len = strlen(keyword);
+	state->max_node_level = max_node_level;
+	state->levels = state->inline_levels;
+	state->depth = 0;
+	state->capacity = ADVANCED_HELP_INLINE_LEVELS;
+	state->forced_include_min_level = ADVANCED_HELP_NO_FORCED_LEVEL;
+	state->nodes_scanned = 0;
+	state->nodes_matched = 0;
+}
 
-HELP_NOMEM_ERROR_LABEL:
-	if (NULL != help_to_show) {
-		free(help_to_show);
-		help_to_show = NULL;
+void freeAdvancedHelpMatchState(_Inout_ AdvancedHelpMatchState* state) {
+	if (state->levels != state->inline_levels) {
+		free(state->levels);
 	}
-	if (NULL != full_help_text) {
-		free(full_help_text);
-		full_help_text = NULL;
+	state->levels = state->inline_levels;
+	state->capacity = ADVANCED_HELP_INLINE_LEVELS;
+	state->depth = 0;
+}
+
+// Moves the levels to the heap (or grows them) so that at least min_capacity levels fit.
+// Returns 0 if the operation was successful, -1 if a realloc error occurred (the state is left intact)
+int growAdvancedHelpMatchState(_Inout_ AdvancedHelpMatchState* state, _In_ size_t min_capacity) {
+	size_t new_capacity = state->capacity * 2;
+	while (new_capacity < min_capacity) {
+		new_capacity *= 2;
+	}
+	AdvancedHelpMatchLevel* tmp_ptr = NULL;
+	if (state->levels == state->inline_levels) {
+		tmp_ptr = (AdvancedHelpMatchLevel*)malloc(sizeof(AdvancedHelpMatchLevel) * new_capacity);
+		if (NULL != tmp_ptr) {
+			memcpy(tmp_ptr, state->inline_levels, sizeof(AdvancedHelpMatchLevel) * state->depth);
+		}
+	} else {
+		tmp_ptr = (AdvancedHelpMatchLevel*)realloc(state->levels, sizeof(AdvancedHelpMatchLevel) * new_capacity);
 	}
-	// Try to copy the error description as output
-	help_to_show = (char*)malloc(strlen(ADVANCED_HELP_NOMEM_ERROR) + 1);
-	if (NULL == help_to_show) {
-		return NULL;	// Not even possible to output the error
+	countAdvancedHelpAllocation();
+	if (NULL == tmp_ptr) {
+		return -1;
 	}
-	strcpy_s(help_to_show, strlen(ADVANCED_HELP_NOMEM_ERROR) + 1, ADVANCED_HELP_NOMEM_ERROR);
-	return help_to_show;
+	state->levels = tmp_ptr;
+	state->capacity = new_capacity;
+	return 0;
 }
 
-WCHAR* getAdvancedHelpForKeywordW(_In_ const WCHAR* keyword, _In_ void* help_ptr) {
-	WCHAR* help_to_show = NULL;
-	WCHAR* full_help_text = NULL;
-	WCHAR* current_nodes[MAX_NODE_LEVEL] = { 0 };
-	bool current_nodes_already_included[MAX_NODE_LEVEL] = { 0 };
-	size_t msg_len = 0;
-
-	if (NULL == help_ptr) {
-		//printf("UNINITIALIZED\n");
-		goto HELP_UNINITIALIZED_ERROR_LABEL;
+// Processes one node of the help (in order) and emits the nodes to be shown because of it: the node itself if it is below a node
+// containing the keyword, or the node and all its parents not shown yet if it contains the keyword.
+// Returns ADVANCED_HELP_STATUS_OK, ADVANCED_HELP_STATUS_FORMAT_ERROR, ADVANCED_HELP_STATUS_NOMEM_ERROR or the first error returned by emit
+AdvancedHelpStatus matchAdvancedHelpNode(_Inout_ AdvancedHelpMatchState* state, _In_ const AdvancedHelpNodeRef* node, _In_ AdvancedHelpEmitFn emit, _Inout_opt_ void* emit_ctx) {
+	size_t level = node->level;
+	state->nodes_scanned++;
+	if (0 != state->max_node_level && level >= state->max_node_level) {
+		return ADVANCED_HELP_STATUS_FORMAT_ERROR;
 	}
 
-	full_help_text = (WCHAR*)malloc(sizeof(WCHAR) * (wcslen((WCHAR*)help_ptr) + 1));
-	if (NULL == full_help_text) {
-		//printf("NO MEM\n");
-		goto HELP_NOMEM_ERROR_LABEL;
+	// Check that nodes do not skip levels (eg, a level 1 node followed by level 3 node without a level 2 node in between)
+	if (level > state->depth) {
+		return ADVANCED_HELP_STATUS_FORMAT_ERROR;
 	}
-	errno_t error = wcscpy_s(full_help_text, wcslen((WCHAR*)help_ptr) + 1, (WCHAR*)help_ptr); // Size must include null termination (L'\0')
-	if (0 != error) {
-		//printf("ERROR: an error (%d) occurred when copying the help to full_help_text\n", error);
-		goto HELP_FORMAT_ERROR_LABEL;
+	if (level >= state->capacity && 0 != growAdvancedHelpMatchState(state, level + 1)) {
+		return ADVANCED_HELP_STATUS_NOMEM_ERROR;
 	}
 
-	// Init arrays
-	for (size_t i = 0; i < MAX_NODE_LEVEL; i++) {
-		current_nodes[i] = NULL;
-		current_nodes_already_included[i] = false;
-	}
+	// Assign current node (subnodes of the previous one are no longer current)
+	state->levels[level].node = *node;
+	state->levels[level].already_included = false;
+	state->depth = level + 1;
 
-	if (0 == wcscmp(L"", keyword)) {
-		//printf("NO keyword\n");
-		return full_help_text;
+	// Check if this node is forced to be added (due to parent node included the keyword)
+	if (ADVANCED_HELP_NO_FORCED_LEVEL != state->forced_include_min_level && state->forced_include_min_level < level) {
+		return emit(emit_ctx, node, NULL);
 	}
 
-	// Nodes are the same as lines, but without the NODE_START_CHAR if needed. No memory is allocated for lines nor nodes
-	WCHAR* line = NULL;
-	WCHAR* current_node = NULL;
-	WCHAR* new_node = NULL;
-	size_t current_node_level = 0;
-	size_t forced_include_min_level = MAX_NODE_LEVEL;
+	// Stop forcing to include
+	state->forced_include_min_level = ADVANCED_HELP_NO_FORCED_LEVEL;
 
-	// Process all the help iteratively line by line
-	// Note:
-	//    When there are no more tokens, line becomes NULL, new_node becomes NULL too, and it will be different from current_node.
-	//    Then the last node is processed.
-	//    Finally, current_node is assigned to new_node (=NULL), allowing the loop to exit
-	int iteration = 0;
-	WCHAR* wcstok_ctx = NULL;
-	do {
-		iteration++;
-		//printf("\n\niteration %d\n", iteration);
+	const char* match = findKeywordInNode(node->text, node->len, state->keyword, state->keyword_len);
+	if (NULL == match) {
+		return ADVANCED_HELP_STATUS_OK;
+	}
 
-		if (NULL == line) {
-			line = wcstok_s(full_help_text, L"\n", &wcstok_ctx);
-		} else {
-			line = wcstok_s(NULL, L"\n", &wcstok_ctx);
+	// Keyword found! Include parent nodes if not already included (+ 1 takes care of the current node)
+	state->nodes_matched++;
+	for (size_t i = 0; i < level + 1; i++) {
+		if (!state->levels[i].already_included) {
+			AdvancedHelpStatus status = emit(emit_ctx, &(state->levels[i].node), (i == level) ? match : NULL);
+			if (ADVANCED_HELP_STATUS_OK != status) {
+				return status;
+			}
+			state->levels[i].already_included = true;
 		}
-		new_node = getLineNodeW(line, current_node);
-		//printf("  line (len=%d):\n%ws\n", (NULL == line) ? -1 : (int)wcslen(line), line);
-		//printf("  current_node (len=%d):\n%ws\n", (NULL == current_node) ? -1 : (int)wcslen(current_node), current_node);
-		//printf("  new_node (len=%d):\n%ws\n", (NULL == new_node) ? -1 : (int)wcslen(new_node), new_node);
+	}
+
+	// Force include everything below this level
+	state->forced_include_min_level = level;
+	return ADVANCED_HELP_STATUS_OK;
+}
 
-		//If current_node is NULL, assign it to the first node and continue, because it is the first iteration
-		if (NULL == current_node) {
-			current_node = new_node;
-			continue;
+// Same as strstr(), but the text does not need to be null-terminated
+const char* findKeywordInNode(_In_ const char* text, _In_ size_t len, _In_ const char* keyword, _In_ size_t keyword_len) {
+	if (0 == keyword_len) {
+		return text;
+	}
+	const char* end = text + len;
+	const char* candidate = text;
+	while ((size_t)(end - candidate) >= keyword_len) {
+		candidate = memchr(candidate, keyword[0], (size_t)(end - candidate) - keyword_len + 1);
+		if (NULL == candidate) {
+			return NULL;
 		}
-		// If the node is the same, continue reading because more tokens may fuse into the same node.
-		if (new_node == current_node || NULL == current_node) {
-			continue;
+		if (0 == memcmp(candidate, keyword, keyword_len)) {
+			return candidate;
 		}
-		//printf("  Proceed to processing...\n");
-
-		// Process current node (already complete with all its lines)
-		current_node_level = getNodeLevelW(current_node);
-		//printf("  current_node_level=%llu\n", current_node_level);
+		candidate++;
+	}
+	return NULL;
+}
 
-		// Check that nodes do not skip levels (eg, a level 1 node followed by level 3 node without a level 2 node in between)
-		for (size_t i = 0; i < current_node_level; i++) {
-			if (NULL == current_nodes[i]) {
-				//printf("current_nodes[%llu]=NULL\n", i);
-				goto HELP_FORMAT_ERROR_LABEL;
-			}
+// Appends src_len chars of src to the buffer (always null-terminated). Grows geometrically to avoid a realloc per append.
+// Returns 0 if the operation was successful, -1 if a realloc error occurred (the buffer is left intact)
+int appendToAdvancedHelpBuffer(_Inout_ AdvancedHelpBuffer* buffer, _In_ const char* src, _In_ size_t src_len) {
+	size_t needed = buffer->len + src_len + 1;	//+ 1 for the final '\0'
+	if (needed > buffer->capacity) {
+		size_t new_capacity = (0 == buffer->capacity) ? 256 : buffer->capacity;
+		while (new_capacity < needed) {
+			new_capacity *= 2;
+		}
+		char* tmp_ptr = (char*)realloc(buffer->data, sizeof(char) * new_capacity);
+		countAdvancedHelpAllocation();
+		if (NULL == tmp_ptr) {
+			return -1;
 		}
+		buffer->data = tmp_ptr;
+		buffer->capacity = new_capacity;
+	}
+	memcpy(buffer->data + buffer->len, src, src_len);
+	buffer->len += src_len;
+	buffer->data[buffer->len] = '\0';
+	return 0;
+}
 
-		// Assign current node
-		current_nodes[current_node_level] = current_node;
-		current_nodes_already_included[current_node_level] = false;
+// AdvancedHelpEmitFn writing every node in its own line to the AdvancedHelpBuffer passed as emit_ctx (same output as getAdvancedHelpForKeyword)
+AdvancedHelpStatus emitNodeToAdvancedHelpBuffer(_Inout_opt_ void* emit_ctx, _In_ const AdvancedHelpNodeRef* node, _In_opt_ const char* match) {
+	(void)match;
+	AdvancedHelpBuffer* buffer = (AdvancedHelpBuffer*)emit_ctx;
+	if ((0 != appendToAdvancedHelpBuffer(buffer, node->text, node->len)) || (0 != appendToAdvancedHelpBuffer(buffer, "\n", 1))) {
+		return ADVANCED_HELP_STATUS_NOMEM_ERROR;
+	}
+	return ADVANCED_HELP_STATUS_OK;
+}
 
-		// Clear subnodes
-		for (size_t i = current_node_level + 1; i < MAX_NODE_LEVEL; i++) {
-			if (NULL == current_nodes[i]) {
-				break;
-			}
-			current_nodes[i] = NULL;
-			current_nodes_already_included[i] = false;
+// Writes the help text as it was loaded (what an empty keyword shows). The nodes of an edited help are no longer in one piece of text,
+// so they are joined again, with the node start char (removed from every node but the first one) put back.
+// Returns 0, or the first non-zero value returned by write
+int writeAdvancedHelpText(_In_ const AdvancedHelp* help, _In_ AdvancedHelpTextWriterFn write, _Inout_opt_ void* write_ctx) {
+	if (!help->edited) {
+		return (0 == help->text_len) ? 0 : write(write_ctx, (const char*)help->text, help->text_len);
+	}
+	for (size_t i = 0; i < help->node_count; i++) {
+		const AdvancedHelpNodeRef* node = &ADVANCED_HELP_NODE(help, i);
+		int error = 0;
+		if (0 != i && '\0' != help->options.node_start_char) {
+			error = write(write_ctx, &(help->options.node_start_char), 1);
 		}
-
-		// Check if this node is forced to be added (due to parent node included the keyword)
-		if (forced_include_min_level < current_node_level) {
-			if ((0 != wcsAppendRealloc(&help_to_show, current_node)) || (0 != wcsAppendRealloc(&help_to_show, L"\n"))) {
-				goto HELP_NOMEM_ERROR_LABEL;
-			}
-		} else {
-			// Stop forcing to include
-			forced_include_min_level = MAX_NODE_LEVEL;
-
-			// Search the keyword in the node
-			if (NULL != wcsstr(current_node, keyword)) {	// Keyword found!
-				// Include parent nodes if not already included (+ 1 takes care of the current node)
-				for (size_t i = 0; i < current_node_level + 1; i++) {
-					if (!current_nodes_already_included[i]) {
-						if ((0 != wcsAppendRealloc(&help_to_show, current_nodes[i])) || (0 != wcsAppendRealloc(&help_to_show, L"\n"))) {
-							goto HELP_NOMEM_ERROR_LABEL;
-						}
-						current_nodes_already_included[i] = true;
-					}
-				}
-
-				// Include current node (already done in the loop above?)
-				//if ((0 != wcsAppendRealloc(&help_to_show, current_node)) || (0 != wcsAppendRealloc(&help_to_show, "\n"))) {
-				//	goto HELP_NOMEM_ERROR_LABEL;
-				//}
-				//current_nodes_already_included[current_node_level] = true;
-
-				// Force include everything below this level
-				forced_include_min_level = current_node_level;
-			}
+		if (0 == error && 0 != node->len) {
+			error = write(write_ctx, node->text, node->len);
+		}
+		if (0 == error) {
+			error = write(write_ctx, "\n", 1);
+		}
+		if (0 != error) {
+			return error;
 		}
+	}
+	return 0;
+}
 
-		current_node = new_node;
-	} while (NULL != current_node);
+int writeToAdvancedHelpBuffer(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len) {
+	return appendToAdvancedHelpBuffer((AdvancedHelpBuffer*)write_ctx, data, len);
+}
 
-	// No errors
-	if (NULL == help_to_show) {
-		goto HELP_KEYWORD_NOT_FOUND_LABEL;
+// Returns a malloc'ed copy of an error/info message, or NULL if there is not enough memory
+char* copyAdvancedHelpMessage(_In_ const char* message) {
+	char* copy = (char*)malloc(strlen(message) + 1);
+	countAdvancedHelpAllocation();
+	if (NULL == copy) {
+		return NULL;
 	}
-	return help_to_show;
+	strcpy_s(copy, strlen(message) + 1, message);
+	return copy;
+}
 
-HELP_UNINITIALIZED_ERROR_LABEL:
-	if (NULL != help_to_show) {
-		free(help_to_show);
-		help_to_show = NULL;
-	}
-	if (NULL != full_help_text) {
-		free(full_help_text);
-		full_help_text = NULL;
+void initAdvancedHelpNodeIteratorW(_Out_ AdvancedHelpNodeIteratorW* iterator, _In_ const WCHAR* help_text, _In_ const AdvancedHelpOptions* options) {
+	iterator->pos = help_text;
+	iterator->line = 1;
+	iterator->first_node = true;
+	iterator->node_level_char = (WCHAR)(unsigned char)options->node_level_char;
+	iterator->node_start_char = (WCHAR)(unsigned char)options->node_start_char;
+}
+
+bool getNextAdvancedHelpNodeW(_Inout_ AdvancedHelpNodeIteratorW* iterator, _Out_ AdvancedHelpNodeRefW* node) {
+	if (L'\t' == iterator->node_level_char && L'\0' == iterator->node_start_char) {
+		return getNextNodeKernelW(iterator, node, L'\t', L'\0');
 	}
-	// Try to copy the error description as output
-	msg_len = wcslen(WTEXT(ADVANCED_HELP_UNINITIALIZED_ERROR));
-	help_to_show = (WCHAR*)malloc(sizeof(WCHAR) * (msg_len + 1));
-	if (NULL == help_to_show) {
-		goto HELP_NOMEM_ERROR_LABEL;
-		//return NULL;	// Not even possible to output the error
+#if NODE_LEVEL_CHAR != '\t' || NODE_START_CHAR != '\0'
+	if (WTEXT(NODE_LEVEL_CHAR) == iterator->node_level_char && WTEXT(NODE_START_CHAR) == iterator->node_start_char) {
+		return getNextNodeKernelW(iterator, node, WTEXT(NODE_LEVEL_CHAR), WTEXT(NODE_START_CHAR));
 	}
-	wcscpy_s(help_to_show, msg_len + 1, WTEXT(ADVANCED_HELP_UNINITIALIZED_ERROR));
-	return help_to_show;
-
+#endif
+	return getNextNodeKernelW(iterator, node, iterator->node_level_char, iterator->node_start_char);
+}
 
-HELP_KEYWORD_NOT_FOUND_LABEL:
-	if (NULL != help_to_show) {
-		free(help_to_show);
-		help_to_show = NULL;
-	}
-	if (NULL != full_help_text) {
-		free(full_help_text);
-		full_help_text = NULL;
+static __forceinline bool getNextNodeKernelW(_Inout_ AdvancedHelpNodeIteratorW* iterator, _Out_ AdvancedHelpNodeRefW* node, _In_ const WCHAR node_level_char, _In_ const WCHAR node_start_char) {
+	const WCHAR* line = iterator->pos;
+	size_t line_number = iterator->line;
+	while (L'\n' == *line) {
+		line++;
+		line_number++;
+	}
+	if (L'\0' == *line) {
+		iterator->pos = line;
+		iterator->line = line_number;
+		return false;
+	}
+
+	const WCHAR* node_text = line;
+	size_t node_line_number = line_number;
+	if (L'\0' != node_start_char && !iterator->first_node && node_start_char == *line) {
+		node_text++;
+	}
+
+	const WCHAR* node_end = wcschr(line, L'\n');
+	if (NULL == node_end) {
+		node_end = line + wcslen(line);
+	}
+	if (L'\0' != node_start_char) {
+		// Append the following lines until a new node starts
+		const WCHAR* next_line = node_end;
+		size_t next_line_number = line_number;
+		while (true) {
+			while (L'\n' == *next_line) {
+				next_line++;
+				next_line_number++;
+			}
+			if (L'\0' == *next_line || node_start_char == *next_line) {
+				break;
+			}
+			line_number = next_line_number;
+			node_end = wcschr(next_line, L'\n');
+			if (NULL == node_end) {
+				node_end = next_line + wcslen(next_line);
+			}
+			next_line = node_end;
+		}
 	}
-	// Try to copy the error description as output
-	msg_len = wcslen(WTEXT(ADVANCED_HELP_KEYWORD_NOT_FOUND_INFO));
-	help_to_show = (WCHAR*)malloc(sizeof(WCHAR) * (msg_len + 1));
-	if (NULL == help_to_show) {
-		goto HELP_NOMEM_ERROR_LABEL;
-		//return NULL;	// Not even possible to output the error
+	iterator->pos = node_end;
+	iterator->line = line_number;
+	iterator->first_node = false;
+
+	node->text = node_text;
+	node->len = (size_t)(node_end - node_text);
+	node->line = node_line_number;
+	node->level = 0;
+	for (const WCHAR* c = node_text; c < node_end; c++) {
+		if (node_level_char == *c) {
+			node->level++;
+		}
 	}
-	wcscpy_s(help_to_show, msg_len + 1, WTEXT(ADVANCED_HELP_KEYWORD_NOT_FOUND_INFO));
-	return help_to_show;
+	return true;
+}
 
+void initAdvancedHelpMatchStateW(_Out_ AdvancedHelpMatchStateW* state, _In_ const WCHAR* keyword, _In_ size_t max_node_level) {
+	state->keyword = keyword;
+	state->keyword_len = wcslen(keyword);
+	state->max_node_level = max_node_level;
+	state->levels = state->inline_levels;
+	state->depth = 0;
+	state->capacity = ADVANCED_HELP_INLINE_LEVELS;
+	state->forced_include_min_level = ADVANCED_HELP_NO_FORCED_LEVEL;
+	state->nodes_scanned = 0;
+	state->nodes_matched = 0;
+}
 
-HELP_FORMAT_ERROR_LABEL:
-	if (NULL != help_to_show) {
-		free(help_to_show);
-		help_to_show = NULL;
+void freeAdvancedHelpMatchStateW(_Inout_ AdvancedHelpMatchStateW* state) {
+	if (state->levels != state->inline_levels) {
+		free(state->levels);
 	}
-	if (NULL != full_help_text) {
-		free(full_help_text);
-		full_help_text = NULL;
-	}
-	// Try to copy the error description as output
-	msg_len = wcslen(WTEXT(ADVANCED_HELP_FORMAT_ERROR));
-	help_to_show = (WCHAR*)malloc(sizeof(WCHAR) * (msg_len + 1));
-	if (NULL == help_to_show) {
-		goto HELP_NOMEM_ERROR_LABEL;
-		//return NULL;	// Not even possible to output the error
-	}
-	wcscpy_s(help_to_show, msg_len + 1, WTEXT(ADVANCED_HELP_FORMAT_ERROR));
-	return help_to_show;
-
+	state->levels = state->inline_levels;
+	state->capacity = ADVANCED_HELP_INLINE_LEVELS;
+	state->depth = 0;
+}
 
-HELP_NOMEM_ERROR_LABEL:
-	if (NULL != help_to_show) {
-		free(help_to_show);
-		help_to_show = NULL;
+int growAdvancedHelpMatchStateW(_Inout_ AdvancedHelpMatchStateW* state, _In_ size_t min_capacity) {
+	size_t new_capacity = state->capacity * 2;
+	while (new_capacity < min_capacity) {
+		new_capacity *= 2;
 	}
-	if (NULL != full_help_text) {
-		free(full_help_text);
-		full_help_text = NULL;
+	AdvancedHelpMatchLevelW* tmp_ptr = NULL;
+	if (state->levels == state->inline_levels) {
+		tmp_ptr = (AdvancedHelpMatchLevelW*)malloc(sizeof(AdvancedHelpMatchLevelW) * new_capacity);
+		if (NULL != tmp_ptr) {
+			memcpy(tmp_ptr, state->inline_levels, sizeof(AdvancedHelpMatchLevelW) * state->depth);
+		}
+	} else {
+		tmp_ptr = (AdvancedHelpMatchLevelW*)realloc(state->levels, sizeof(AdvancedHelpMatchLevelW) * new_capacity);
 	}
-	// Try to copy the error description as output
-	msg_len = wcslen(WTEXT(ADVANCED_HELP_NOMEM_ERROR));
-	help_to_show = (WCHAR*)malloc(sizeof(WCHAR) * (msg_len + 1));
-	if (NULL == help_to_show) {
-		return NULL;	// Not even possible to output the error
+	countAdvancedHelpAllocation();
+	if (NULL == tmp_ptr) {
+		return -1;
 	}
-	wcscpy_s(help_to_show, msg_len + 1, WTEXT(ADVANCED_HELP_NOMEM_ERROR));
-	return help_to_show;
+	state->levels = tmp_ptr;
+	state->capacity = new_capacity;
+	return 0;
 }
 
+AdvancedHelpStatus matchAdvancedHelpNodeW(_Inout_ AdvancedHelpMatchStateW* state, _In_ const AdvancedHelpNodeRefW* node, _In_ AdvancedHelpEmitFnW emit, _Inout_opt_ void* emit_ctx) {
+	size_t level = node->level;
+	state->nodes_scanned++;
+	if (0 != state->max_node_level && level >= state->max_node_level) {
+		return ADVANCED_HELP_STATUS_FORMAT_ERROR;
+	}
 
-char* getLineNode(_In_ char* new_line, _In_opt_ char* current_node) {
-	if (NULL == new_line) {
-		return NULL;
+	// Check that nodes do not skip levels (eg, a level 1 node followed by level 3 node without a level 2 node in between)
+	if (level > state->depth) {
+		return ADVANCED_HELP_STATUS_FORMAT_ERROR;
 	}
-	if (NULL == current_node) {
-		return new_line;
+	if (level >= state->capacity && 0 != growAdvancedHelpMatchStateW(state, level + 1)) {
+		return ADVANCED_HELP_STATUS_NOMEM_ERROR;
 	}
 
-	if ('\0' == NODE_START_CHAR) {
-		return new_line;	// New line is always a new node
-	} else if (new_line[0] == NODE_START_CHAR) {
-		return &(new_line[1]);	// New line is a new node, but special character is removed
-	} else {
-		// New line is part of the last node. Concatenate restoring removed '\n' (can be several due to strtok behaviour) and return the same node again.
-		//current_node[strlen(current_node)] = '\n';
-		size_t i = strlen(current_node);
-		while ('\0' == current_node[i]) {
-			current_node[i] = '\n';
-			i++;
-		}
-		return current_node;
-	}
-}
-WCHAR* getLineNodeW(_In_ WCHAR* new_line, _In_opt_ WCHAR* current_node) {
-	if (NULL == new_line) {
-		return NULL;
+	// Assign current node (subnodes of the previous one are no longer current)
+	state->levels[level].node = *node;
+	state->levels[level].already_included = false;
+	state->depth = level + 1;
+
+	// Check if this node is forced to be added (due to parent node included the keyword)
+	if (ADVANCED_HELP_NO_FORCED_LEVEL != state->forced_include_min_level && state->forced_include_min_level < level) {
+		return emit(emit_ctx, node, NULL);
 	}
-	if (NULL == current_node) {
-		return new_line;
+
+	// Stop forcing to include
+	state->forced_include_min_level = ADVANCED_HELP_NO_FORCED_LEVEL;
+
+	const WCHAR* match = findKeywordInNodeW(node->text, node->len, state->keyword, state->keyword_len);
+	if (NULL == match) {
+		return ADVANCED_HELP_STATUS_OK;
 	}
 
-	if (L'\0' == WTEXT(NODE_START_CHAR)) {
-		return new_line;	// New line is always a new node
-	} else if (new_line[0] == WTEXT(NODE_START_CHAR)) {
-		return &(new_line[1]);	// New line is a new node, but special character is removed
-	} else {
-		// New line is part of the last node. Concatenate restoring removed '\n' (can be several due to strtok behaviour) and return the same node again.
-		//current_node[wcslen(current_node)] = L'\n';
-		size_t i = wcslen(current_node);
-		while (L'\0' == current_node[i]) {
-			current_node[i] = L'\n';
-			i++;
+	// Keyword found! Include parent nodes if not already included (+ 1 takes care of the current node)
+	state->nodes_matched++;
+	for (size_t i = 0; i < level + 1; i++) {
+		if (!state->levels[i].already_included) {
+			AdvancedHelpStatus status = emit(emit_ctx, &(state->levels[i].node), (i == level) ? match : NULL);
+			if (ADVANCED_HELP_STATUS_OK != status) {
+				return status;
+			}
+			state->levels[i].already_included = true;
 		}
-		return current_node;
 	}
+
+	// Force include everything below this level
+	state->forced_include_min_level = level;
+	return ADVANCED_HELP_STATUS_OK;
 }
 
-size_t getNodeLevel(_In_ const char* current_node) {
-	if (NULL == current_node) {
-		return 0;
+const WCHAR* findKeywordInNodeW(_In_ const WCHAR* text, _In_ size_t len, _In_ const WCHAR* keyword, _In_ size_t keyword_len) {
+	if (0 == keyword_len) {
+		return text;
+	}
+	const WCHAR* end = text + len;
+	const WCHAR* candidate = text;
+	while ((size_t)(end - candidate) >= keyword_len) {
+		candidate = wmemchr(candidate, keyword[0], (size_t)(end - candidate) - keyword_len + 1);
+		if (NULL == candidate) {
+			return NULL;
+		}
+		if (0 == wmemcmp(candidate, keyword, keyword_len)) {
+			return candidate;
+		}
+		candidate++;
 	}
+	return NULL;
+}
 
-	size_t current_node_level = 0;
-	for (size_t i = 0; i < strlen(current_node); i++) {
-		if (NODE_LEVEL_CHAR == current_node[i]) {
-			current_node_level++;
+int appendToAdvancedHelpBufferW(_Inout_ AdvancedHelpBufferW* buffer, _In_ const WCHAR* src, _In_ size_t src_len) {
+	size_t needed = buffer->len + src_len + 1;	//+ 1 for the final L'\0'
+	if (needed > buffer->capacity) {
+		size_t new_capacity = (0 == buffer->capacity) ? 256 : buffer->capacity;
+		while (new_capacity < needed) {
+			new_capacity *= 2;
+		}
+		WCHAR* tmp_ptr = (WCHAR*)realloc(buffer->data, sizeof(WCHAR) * new_capacity);
+		countAdvancedHelpAllocation();
+		if (NULL == tmp_ptr) {
+			return -1;
 		}
+		buffer->data = tmp_ptr;
+		buffer->capacity = new_capacity;
 	}
-	return current_node_level;
+	wmemcpy(buffer->data + buffer->len, src, src_len);
+	buffer->len += src_len;
+	buffer->data[buffer->len] = L'\0';
+	return 0;
 }
 
-size_t getNodeLevelW(_In_ const WCHAR* current_node) {
-	if (NULL == current_node) {
-		return 0;
+AdvancedHelpStatus emitNodeToAdvancedHelpBufferW(_Inout_opt_ void* emit_ctx, _In_ const AdvancedHelpNodeRefW* node, _In_opt_ const WCHAR* match) {
+	(void)match;
+	AdvancedHelpBufferW* buffer = (AdvancedHelpBufferW*)emit_ctx;
+	if ((0 != appendToAdvancedHelpBufferW(buffer, node->text, node->len)) || (0 != appendToAdvancedHelpBufferW(buffer, L"\n", 1))) {
+		return ADVANCED_HELP_STATUS_NOMEM_ERROR;
 	}
+	return ADVANCED_HELP_STATUS_OK;
+}
 
-	size_t current_node_level = 0;
-	for (size_t i = 0; i < wcslen(current_node); i++) {
-		if (WTEXT(NODE_LEVEL_CHAR) == current_node[i]) {
-			current_node_level++;
-		}
+WCHAR* copyAdvancedHelpMessageW(_In_ const WCHAR* message) {
+	WCHAR* copy = (WCHAR*)malloc(sizeof(WCHAR) * (wcslen(message) + 1));
+	countAdvancedHelpAllocation();
+	if (NULL == copy) {
+		return NULL;
 	}
-	return current_node_level;
+	wcscpy_s(copy, wcslen(message) + 1, message);
+	return copy;
 }
 
 
@@ -552,6 +782,7 @@ int strAppendRealloc(_Inout_ char** dest, _In_ const char* src) {
 
 	// Reallocate memory (*dest being NULL is already handled by realloc)
 	char* tmp_ptr = (char*)realloc(*dest, sizeof(char) * (current_len + src_len + 1)); //+ 1 for the final '\0'
+	countAdvancedHelpAllocation();
 	if (NULL == tmp_ptr) {
 		// Memory allocation failed. Leave the original pointer intact.
 		//perror("Error in realloc");
@@ -588,6 +819,7 @@ int wcsAppendRealloc(_Inout_ WCHAR** dest, _In_ const WCHAR* src) {
 
 	// Reallocate memory (*dest being NULL is already handled by realloc)
 	WCHAR* tmp_ptr = (WCHAR*)realloc(*dest, sizeof(WCHAR) * (current_len + src_len + 1)); //+ 1 for the final '\0'
+	countAdvancedHelpAllocation();
 	if (NULL == tmp_ptr) {
 		// Memory allocation failed. Leave the original pointer intact.
 		//perror("Error in realloc");
@@ -603,7 +835,17 @@ int wcsAppendRealloc(_Inout_ WCHAR** dest, _In_ const WCHAR* src) {
 
 void freeAdvancedHelp(_In_ void** help_ptr) {
 	if (NULL != *help_ptr) {
-		free(*help_ptr);
+		AdvancedHelp* help = (AdvancedHelp*)*help_ptr;
+		freeAdvancedHelpSnapshot(help->snapshot);
+		while (NULL != help->added_text) {
+			AdvancedHelpTextChunk* next = help->added_text->next;
+			free(help->added_text);
+			help->added_text = next;
+		}
+		free(help->nodes);
+		free(help->nodes_w);
+		free(help->text);
+		free(help);
 		*help_ptr = NULL;
 	}
 	return;
@@ -613,10 +855,163 @@ void freeAdvancedHelpW(_In_ void** help_ptr) {
 }
 
 int initAdvancedHelp(_In_ const char* help_filename, _Inout_ void** help_ptr) {
-	return getTextFromFile(help_filename, (char**)help_ptr);
+	return initAdvancedHelpEx(help_filename, NULL, help_ptr);
 }
 int initAdvancedHelpW(_In_ const WCHAR* help_filename, _Inout_ void** help_ptr) {
-	return getTextFromFileW(help_filename, (WCHAR**)help_ptr);
+	return initAdvancedHelpExW(help_filename, NULL, help_ptr);
+}
+
+// Returns 0 on success, -2 if there is not enough memory, or the errors of getTextFromFile (-1 if already initialized)
+int initAdvancedHelpEx(_In_ const char* help_filename, _In_opt_ const AdvancedHelpOptions* options, _Inout_ void** help_ptr) {
+	AdvancedHelpStatsRecord stats_record;
+	beginAdvancedHelpLoadStats(&stats_record);
+	char* help_text = NULL;
+	int error = (NULL != *help_ptr) ? -1 : getTextFromFile(help_filename, &help_text);
+	if (0 == error) {
+		error = createAdvancedHelp(help_text, false, options, help_ptr);
+	}
+	endAdvancedHelpInitStats(&stats_record, error, *help_ptr);
+	return error;
+}
+int initAdvancedHelpExW(_In_ const WCHAR* help_filename, _In_opt_ const AdvancedHelpOptions* options, _Inout_ void** help_ptr) {
+	AdvancedHelpStatsRecord stats_record;
+	beginAdvancedHelpLoadStats(&stats_record);
+	WCHAR* help_text = NULL;
+	int error = (NULL != *help_ptr) ? -1 : getTextFromFileW(help_filename, &help_text);
+	if (0 == error) {
+		error = createAdvancedHelp(help_text, true, options, help_ptr);
+	}
+	endAdvancedHelpInitStats(&stats_record, error, *help_ptr);
+	return error;
+}
+
+// Same as initAdvancedHelpEx(), with the help text already in memory. The text is copied, so it may be freed afterwards
+int initAdvancedHelpFromText(_In_ const char* help_text, _In_opt_ const AdvancedHelpOptions* options, _Inout_ void** help_ptr) {
+	if (NULL != *help_ptr || NULL == help_text) {
+		return -1;
+	}
+	AdvancedHelpStatsRecord stats_record;
+	beginAdvancedHelpLoadStats(&stats_record);
+	int error = -2;
+	size_t text_len = strlen(help_text);
+	char* text_copy = (char*)malloc(sizeof(char) * (text_len + 1));
+	countAdvancedHelpAllocation();
+	if (NULL != text_copy) {
+		memcpy(text_copy, help_text, sizeof(char) * (text_len + 1));
+		error = createAdvancedHelp(text_copy, false, options, help_ptr);
+	}
+	endAdvancedHelpInitStats(&stats_record, error, *help_ptr);
+	return error;
+}
+int initAdvancedHelpFromTextW(_In_ const WCHAR* help_text, _In_opt_ const AdvancedHelpOptions* options, _Inout_ void** help_ptr) {
+	if (NULL != *help_ptr || NULL == help_text) {
+		return -1;
+	}
+	AdvancedHelpStatsRecord stats_record;
+	beginAdvancedHelpLoadStats(&stats_record);
+	int error = -2;
+	size_t text_len = wcslen(help_text);
+	WCHAR* text_copy = (WCHAR*)malloc(sizeof(WCHAR) * (text_len + 1));
+	countAdvancedHelpAllocation();
+	if (NULL != text_copy) {
+		wmemcpy(text_copy, help_text, text_len + 1);
+		error = createAdvancedHelp(text_copy, true, options, help_ptr);
+	}
+	endAdvancedHelpInitStats(&stats_record, error, *help_ptr);
+	return error;
+}
+
+// Creates the help handle for a loaded text, which is owned by the help from now on (it is freed if an error occurs).
+// Returns 0 on success, -2 if there is not enough memory, -4 if there is no text
+int createAdvancedHelp(_In_ void* text, _In_ bool is_wide, _In_opt_ const AdvancedHelpOptions* options, _Inout_ void** help_ptr) {
+	const AdvancedHelpOptions default_options = ADVANCED_HELP_DEFAULT_OPTIONS;
+	if (NULL == text) {
+		return -4;	// getTextFromFile() does not read anything if the end of the file can not be found
+	}
+
+	AdvancedHelp* help = (AdvancedHelp*)calloc(1, sizeof(AdvancedHelp));
+	countAdvancedHelpAllocation();
+	if (NULL == help) {
+		free(text);
+		return -2;
+	}
+	help->options = (NULL != options) ? *options : default_options;
+	help->is_wide = is_wide;
+	help->text = text;
+
+	int error = is_wide ? buildAdvancedHelpNodeTableW(help) : buildAdvancedHelpNodeTable(help);
+	if (0 != error) {
+		void* help_to_free = help;
+		freeAdvancedHelp(&help_to_free);
+		return error;
+	}
+	*help_ptr = help;
+	return 0;
+}
+
+// Splits the text of the help into nodes (see getNextAdvancedHelpNode), so queries do not need to parse it again.
+// Returns 0 if the operation was successful, -2 if there is not enough memory
+int buildAdvancedHelpNodeTable(_Inout_ AdvancedHelp* help) {
+	AdvancedHelpNodeIterator iterator;
+	AdvancedHelpNodeRef node;
+	initAdvancedHelpNodeIterator(&iterator, (const char*)help->text, &(help->options));
+	while (getNextAdvancedHelpNode(&iterator, &node)) {
+		if (help->node_count == help->node_capacity) {
+			size_t new_capacity = (0 == help->node_capacity) ? 64 : help->node_capacity * 2;
+			AdvancedHelpNodeRef* tmp_ptr = (AdvancedHelpNodeRef*)realloc(help->nodes, sizeof(AdvancedHelpNodeRef) * new_capacity);
+			countAdvancedHelpAllocation();
+			if (NULL == tmp_ptr) {
+				return -2;
+			}
+			help->nodes = tmp_ptr;
+			help->node_capacity = new_capacity;
+		}
+		help->nodes[help->node_count] = node;
+		help->node_count++;
+		if (node.level > help->max_level) {
+			help->max_level = node.level;
+		}
+	}
+	help->text_len = (size_t)(iterator.pos - (const char*)help->text);
+
+	// The free space at the end of the table is the gap
+	help->gap_start = help->node_count;
+	help->gap_len = help->node_capacity - help->node_count;
+	return 0;
+}
+int buildAdvancedHelpNodeTableW(_Inout_ AdvancedHelp* help) {
+	AdvancedHelpNodeIteratorW iterator;
+	AdvancedHelpNodeRefW node;
+	size_t capacity = 0;
+	initAdvancedHelpNodeIteratorW(&iterator, (const WCHAR*)help->text, &(help->options));
+	while (getNextAdvancedHelpNodeW(&iterator, &node)) {
+		if (help->node_count == capacity) {
+			size_t new_capacity = (0 == capacity) ? 64 : capacity * 2;
+			AdvancedHelpNodeRefW* tmp_ptr = (AdvancedHelpNodeRefW*)realloc(help->nodes_w, sizeof(AdvancedHelpNodeRefW) * new_capacity);
+			countAdvancedHelpAllocation();
+			if (NULL == tmp_ptr) {
+				return -2;
+			}
+			help->nodes_w = tmp_ptr;
+			capacity = new_capacity;
+		}
+		help->nodes_w[help->node_count] = node;
+		help->node_count++;
+		if (node.level > help->max_level) {
+			help->max_level = node.level;
+		}
+	}
+	help->text_len = (size_t)(iterator.pos - (const WCHAR*)help->text);
+	return 0;
+}
+
+void endAdvancedHelpInitStats(_In_ const AdvancedHelpStatsRecord* record, _In_ int error, _In_opt_ const void* help_ptr) {
+	const AdvancedHelp* help = (const AdvancedHelp*)help_ptr;
+	if (0 != error || NULL == help) {
+		endAdvancedHelpLoadStats(record, false, 0, 0, 0);
+		return;
+	}
+	endAdvancedHelpLoadStats(record, true, (help->is_wide ? sizeof(WCHAR) : sizeof(char)) * help->text_len, help->node_count, help->max_level);
 }
 
 int getTextFromFile(_In_ const char* text_filename, _Inout_ char** text_ptr) {
@@ -23,10 +23,13 @@ extern "C" {
 
 /////   DEFINES   /////
 
+// Default format of the helps (see AdvancedHelpOptions to use other formats without rebuilding)
 #define MAX_NODE_LEVEL 16
 #define NODE_LEVEL_CHAR '\t'
 #define NODE_START_CHAR '\0'	// If null (= '\0'), then every new line will be interpreted as a new node (e.g. a new section or a new param), which means nodes will be one-liners
 
+#define ADVANCED_HELP_DEFAULT_OPTIONS { MAX_NODE_LEVEL, NODE_LEVEL_CHAR, NODE_START_CHAR }
+
 #define WTEXT_IMPL(name)    L##name
 #define WTEXT(name)         WTEXT_IMPL(name)
 
@@ -34,19 +37,61 @@ extern "C" {
 #define ADVANCED_HELP_FORMAT_ERROR "ADVANCED HELP ERROR: help is incorrectly formatted.\n"
 #define ADVANCED_HELP_NOMEM_ERROR "ADVANCED HELP ERROR: not enough memory to show the help.\n"
 #define ADVANCED_HELP_KEYWORD_NOT_FOUND_INFO "ADVANCED HELP INFO: the keyword entered could not be found.\n"
+#define ADVANCED_HELP_SINK_ERROR "ADVANCED HELP ERROR: the help could not be written to the output.\n"
+#define ADVANCED_HELP_CANCELLED_INFO "ADVANCED HELP INFO: the query was cancelled.\n"
 
 #define DEFAULT_HELP_FILEPATH "help.txt"
 
 
 
+/////   TYPES   /////
+
+	// Outcome of a query. Errors are negative
+	typedef enum AdvancedHelpStatus {
+		ADVANCED_HELP_STATUS_OK = 0,
+		ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND = 1,
+		ADVANCED_HELP_STATUS_FORMAT_ERROR = -1,
+		ADVANCED_HELP_STATUS_NOMEM_ERROR = -2,
+		ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR = -3,
+		ADVANCED_HELP_STATUS_SINK_ERROR = -4,		// Only returned when writing to an output sink
+		ADVANCED_HELP_STATUS_CANCELLED = -5,		// Only returned by asynchronous queries
+	} AdvancedHelpStatus;
+
+	// Format of a help, fixed when it is initialized. Same meaning as the defines with the same name
+	typedef struct AdvancedHelpOptions {
+		size_t max_node_level;		// Nodes at this level or deeper are a format error. 0 means no limit
+		char node_level_char;
+		char node_start_char;
+	} AdvancedHelpOptions;
+
+	// Where an ADVANCED_HELP_STATUS_FORMAT_ERROR was found: first line (1-based) and level of the offending node. 0 if unknown
+	typedef struct AdvancedHelpErrorInfo {
+		size_t line;
+		size_t level;
+	} AdvancedHelpErrorInfo;
+
+
+
 /////   FUNCTION DEFINITIONS   /////
 
 	char* getAdvancedHelpForKeyword(_In_ const char* keyword, _In_ void* help_ptr);
 	WCHAR* getAdvancedHelpForKeywordW(_In_ const WCHAR* keyword, _In_ void* help_ptr);
 
+	AdvancedHelpStatus getAdvancedHelpForKeywordEx(_In_ const char* keyword, _In_ void* help_ptr, _Out_ char** result_ptr, _Out_opt_ size_t* result_len, _Out_opt_ AdvancedHelpErrorInfo* error_info);
+	AdvancedHelpStatus getAdvancedHelpForKeywordExW(_In_ const WCHAR* keyword, _In_ void* help_ptr, _Out_ WCHAR** result_ptr, _Out_opt_ size_t* result_len, _Out_opt_ AdvancedHelpErrorInfo* error_info);
+
+	const char* getAdvancedHelpStatusMessage(_In_ AdvancedHelpStatus status);
+	const WCHAR* getAdvancedHelpStatusMessageW(_In_ AdvancedHelpStatus status);
+
 	int initAdvancedHelp(_In_ const char* help_filename, _Inout_ void** help_ptr);
 	int initAdvancedHelpW(_In_ const WCHAR* help_filename, _Inout_ void** help_ptr);
 
+	// Same as initAdvancedHelp(), with the format of the help given at run time (NULL options means ADVANCED_HELP_DEFAULT_OPTIONS)
+	int initAdvancedHelpEx(_In_ const char* help_filename, _In_opt_ const AdvancedHelpOptions* options, _Inout_ void** help_ptr);
+	int initAdvancedHelpExW(_In_ const WCHAR* help_filename, _In_opt_ const AdvancedHelpOptions* options, _Inout_ void** help_ptr);
+	int initAdvancedHelpFromText(_In_ const char* help_text, _In_opt_ const AdvancedHelpOptions* options, _Inout_ void** help_ptr);
+	int initAdvancedHelpFromTextW(_In_ const WCHAR* help_text, _In_opt_ const AdvancedHelpOptions* options, _Inout_ void** help_ptr);
+
 	void freeAdvancedHelp(_In_ void** help_ptr);
 	void freeAdvancedHelpW(_In_ void** help_ptr);
 
@@ -0,0 +1,254 @@
+/////   INCLUDES   /////
+
+#include "advanced_help_async.h"
+#include "advanced_help_internal.h"
+
+
+
+
+/////   DEFINES   /////
+
+#define ASYNC_CANCELLED_ERROR -5
+
+
+
+
+/////   TYPES   /////
+
+// A load or a query submitted to the thread pool. Only the work callback writes the result, and done is set after it and after the user callback
+typedef struct AdvancedHelpAsync {
+	PTP_WORK work;
+	bool is_load;
+	volatile LONG cancelled;
+	volatile LONG done;
+	AdvancedHelpAsyncCallback callback;
+	void* callback_ctx;
+	HANDLE event;
+
+	// Load
+	bool has_options;
+	AdvancedHelpOptions options;
+	int load_error;
+	void* help_ptr;		// Loaded help, or help being queried
+
+	// Query
+	AdvancedHelpStatus status;
+	char* result;
+	size_t result_len;
+	AdvancedHelpErrorInfo error_info;
+	bool result_taken;
+
+	char text[];		// Help filename or keyword
+} AdvancedHelpAsync;
+
+
+
+
+/////   GLOBAL VARS   /////
+
+// Operation whose user callback is running in this thread, so the getters called from it do not wait for the work (it would never end)
+__declspec(thread) AdvancedHelpAsync* current_async_callback = NULL;
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+int createAdvancedHelpAsync(_In_ const char* text, _In_ bool is_load, _In_opt_ AdvancedHelpAsyncCallback callback, _Inout_opt_ void* callback_ctx, _In_opt_ HANDLE event, _Out_ AdvancedHelpAsync** async_out);
+VOID CALLBACK runAdvancedHelpAsync(_Inout_ PTP_CALLBACK_INSTANCE instance, _Inout_opt_ PVOID context, _Inout_ PTP_WORK work);
+void loadAdvancedHelpAsync(_Inout_ AdvancedHelpAsync* async);
+void waitAdvancedHelpAsync(_In_ AdvancedHelpAsync* async);
+
+
+
+
+/////   FUNCTION IMPLEMENTATIONS   /////
+
+// Starts loading a help file in the background, with the same options as initAdvancedHelpEx().
+// Returns 0 if the load was started, -1 if the arguments are wrong (or *async_ptr is not NULL), -2 if there is not enough memory.
+// The result of the load is got with getAdvancedHelpAsyncLoadResult()
+int initAdvancedHelpAsync(_In_ const char* help_filename, _In_opt_ const AdvancedHelpOptions* options, _In_opt_ AdvancedHelpAsyncCallback callback, _Inout_opt_ void* callback_ctx, _In_opt_ HANDLE event, _Inout_ void** async_ptr) {
+	if (NULL == help_filename || NULL == async_ptr || NULL != *async_ptr) {
+		return -1;
+	}
+	AdvancedHelpAsync* async = NULL;
+	int error = createAdvancedHelpAsync(help_filename, true, callback, callback_ctx, event, &async);
+	if (0 != error) {
+		return error;
+	}
+	if (NULL != options) {
+		async->has_options = true;
+		async->options = *options;
+	}
+	SubmitThreadpoolWork(async->work);
+	*async_ptr = async;
+	return 0;
+}
+
+// Starts a query of getAdvancedHelpForKeywordEx() in the background. Same errors as initAdvancedHelpAsync().
+// The result of the query is got with getAdvancedHelpAsyncQueryResult()
+int getAdvancedHelpForKeywordAsync(_In_ const char* keyword, _In_ void* help_ptr, _In_opt_ AdvancedHelpAsyncCallback callback, _Inout_opt_ void* callback_ctx, _In_opt_ HANDLE event, _Inout_ void** async_ptr) {
+	const AdvancedHelp* help = (const AdvancedHelp*)help_ptr;
+	if (NULL == keyword || NULL == help || help->is_wide || NULL == async_ptr || NULL != *async_ptr) {
+		return -1;
+	}
+	AdvancedHelpAsync* async = NULL;
+	int error = createAdvancedHelpAsync(keyword, false, callback, callback_ctx, event, &async);
+	if (0 != error) {
+		return error;
+	}
+	async->help_ptr = help_ptr;
+	SubmitThreadpoolWork(async->work);
+	*async_ptr = async;
+	return 0;
+}
+
+// Allocates an operation and its thread pool work, without submitting it. Returns 0 on success, -2 if there is not enough memory
+int createAdvancedHelpAsync(_In_ const char* text, _In_ bool is_load, _In_opt_ AdvancedHelpAsyncCallback callback, _Inout_opt_ void* callback_ctx, _In_opt_ HANDLE event, _Out_ AdvancedHelpAsync** async_out) {
+	size_t text_len = strlen(text);
+	AdvancedHelpAsync* async = (AdvancedHelpAsync*)calloc(1, sizeof(AdvancedHelpAsync) + sizeof(char) * (text_len + 1));
+	countAdvancedHelpAllocation();
+	if (NULL == async) {
+		return -2;
+	}
+	memcpy(async->text, text, sizeof(char) * (text_len + 1));
+	async->is_load = is_load;
+	async->callback = callback;
+	async->callback_ctx = callback_ctx;
+	async->event = event;
+	async->load_error = -2;
+	async->status = ADVANCED_HELP_STATUS_NOMEM_ERROR;
+
+	async->work = CreateThreadpoolWork(runAdvancedHelpAsync, async, NULL);
+	if (NULL == async->work) {
+		free(async);
+		return -2;
+	}
+	*async_out = async;
+	return 0;
+}
+
+// Runs in a thread pool thread
+VOID CALLBACK runAdvancedHelpAsync(_Inout_ PTP_CALLBACK_INSTANCE instance, _Inout_opt_ PVOID context, _Inout_ PTP_WORK work) {
+	(void)instance;
+	(void)work;
+	AdvancedHelpAsync* async = (AdvancedHelpAsync*)context;
+	if (async->is_load) {
+		loadAdvancedHelpAsync(async);
+	} else {
+		async->status = queryAdvancedHelp(async->text, async->help_ptr, &(async->result), &(async->result_len), &(async->error_info), &(async->cancelled));
+	}
+
+	// Done only after the callback, so a result taken by the callback is never taken again by a thread that polled or waited for the event
+	if (NULL != async->callback) {
+		current_async_callback = async;
+		async->callback(async->callback_ctx, async);
+		current_async_callback = NULL;
+	}
+	InterlockedExchange(&(async->done), 1);
+	if (NULL != async->event) {
+		SetEvent(async->event);
+	}
+}
+
+// Same as initAdvancedHelpEx(), except that a cancel between reading the file and parsing it skips the parsing
+void loadAdvancedHelpAsync(_Inout_ AdvancedHelpAsync* async) {
+	AdvancedHelpStatsRecord stats_record;
+	beginAdvancedHelpLoadStats(&stats_record);
+	char* help_text = NULL;
+	int error = (0 != async->cancelled) ? ASYNC_CANCELLED_ERROR : getTextFromFile(async->text, &help_text);
+	if (0 == error && 0 != async->cancelled) {
+		free(help_text);
+		error = ASYNC_CANCELLED_ERROR;
+	}
+	if (0 == error) {
+		error = createAdvancedHelp(help_text, false, async->has_options ? &(async->options) : NULL, &(async->help_ptr));
+	}
+	endAdvancedHelpInitStats(&stats_record, error, async->help_ptr);
+	async->load_error = error;
+}
+
+// Asks the operation to stop. A load stops before parsing the file, a query before its next node; an operation that had already
+// finished keeps its result. Returns immediately: the operation still completes (with the cancelled error) through the callback or event
+void cancelAdvancedHelpAsync(_In_ void* async_ptr) {
+	AdvancedHelpAsync* async = (AdvancedHelpAsync*)async_ptr;
+	if (NULL != async) {
+		InterlockedExchange(&(async->cancelled), 1);
+	}
+}
+
+// True once the operation and its callback (if any) finished
+bool isAdvancedHelpAsyncDone(_In_ void* async_ptr) {
+	const AdvancedHelpAsync* async = (const AdvancedHelpAsync*)async_ptr;
+	return NULL != async && 0 != ReadAcquire(&(async->done));
+}
+
+// Waits for the load to finish and moves the help to *help_ptr (which must be NULL), so it is only got once.
+// Returns the error of initAdvancedHelpEx(), -5 if the load was cancelled, or -1 if the arguments are wrong or the help was already taken
+int getAdvancedHelpAsyncLoadResult(_In_ void* async_ptr, _Inout_ void** help_ptr) {
+	AdvancedHelpAsync* async = (AdvancedHelpAsync*)async_ptr;
+	if (NULL == async || !async->is_load || NULL == help_ptr || NULL != *help_ptr) {
+		return -1;
+	}
+	waitAdvancedHelpAsync(async);
+	if (0 != async->load_error) {
+		return async->load_error;
+	}
+	if (NULL == async->help_ptr) {
+		return -1;
+	}
+	*help_ptr = async->help_ptr;
+	async->help_ptr = NULL;
+	return 0;
+}
+
+// Waits for the query to finish and returns what getAdvancedHelpForKeywordEx() would have, or ADVANCED_HELP_STATUS_CANCELLED.
+// The result is moved to *result_ptr (to be freed by the caller), so it is only got once: later calls return ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR
+AdvancedHelpStatus getAdvancedHelpAsyncQueryResult(_In_ void* async_ptr, _Out_ char** result_ptr, _Out_opt_ size_t* result_len, _Out_opt_ AdvancedHelpErrorInfo* error_info) {
+	AdvancedHelpAsync* async = (AdvancedHelpAsync*)async_ptr;
+	if (NULL == result_ptr) {
+		return ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR;
+	}
+	*result_ptr = NULL;
+	if (NULL == async || async->is_load) {
+		return ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR;
+	}
+	waitAdvancedHelpAsync(async);
+	if (async->result_taken) {
+		return ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR;
+	}
+	*result_ptr = async->result;
+	if (NULL != result_len) {
+		*result_len = async->result_len;
+	}
+	if (NULL != error_info) {
+		*error_info = async->error_info;
+	}
+	async->result = NULL;
+	async->result_taken = true;
+	return async->status;
+}
+
+// Doesn't wait if called from the callback, since the result is already set then
+void waitAdvancedHelpAsync(_In_ AdvancedHelpAsync* async) {
+	if (current_async_callback != async && 0 == ReadAcquire(&(async->done))) {
+		WaitForThreadpoolWorkCallbacks(async->work, FALSE);
+	}
+}
+
+// Waits for the operation to finish (cancel it first to not wait for the whole query) and frees it, with any result that was not taken.
+// Must not be called from the callback
+void freeAdvancedHelpAsync(_Inout_ void** async_ptr) {
+	if (NULL == async_ptr || NULL == *async_ptr) {
+		return;
+	}
+	AdvancedHelpAsync* async = (AdvancedHelpAsync*)*async_ptr;
+	WaitForThreadpoolWorkCallbacks(async->work, FALSE);
+	CloseThreadpoolWork(async->work);
+	if (async->is_load) {
+		freeAdvancedHelp(&(async->help_ptr));
+	}
+	free(async->result);
+	free(async);
+	*async_ptr = NULL;
+}
@@ -0,0 +1,51 @@
+#ifndef ADVANCED_HELP_ASYNC_H
+#define ADVANCED_HELP_ASYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+	/////   INCLUDES   /////
+#include "advanced_help.h"
+
+
+
+
+
+/////   TYPES   /////
+
+	// Called from a thread pool thread when an asynchronous operation finishes (also if it failed or was cancelled).
+	// The result may be taken from the callback, but the operation must not be freed there. isAdvancedHelpAsyncDone() and the event only
+	// report the operation as done after the callback returns (and getters called from other threads wait for it), so the result is only taken once
+	typedef void (*AdvancedHelpAsyncCallback)(_Inout_opt_ void* callback_ctx, _In_ void* async_ptr);
+
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+	// Loads and queries that run in the process thread pool, so that the calling thread (e.g. the event loop of a server) never blocks on
+	// the file or the search. Completion is delivered through the callback and/or by setting the event, which the loop can wait for along
+	// with its other handles (WaitForMultipleObjects, RegisterWaitForSingleObject...). Both are optional: isAdvancedHelpAsyncDone() can be polled too.
+	// The event belongs to the caller and must stay open until the operation is freed.
+	// A query keeps using its help until it finishes: the help must not be freed or edited before that. WCHAR helps are not supported.
+
+	int initAdvancedHelpAsync(_In_ const char* help_filename, _In_opt_ const AdvancedHelpOptions* options, _In_opt_ AdvancedHelpAsyncCallback callback, _Inout_opt_ void* callback_ctx, _In_opt_ HANDLE event, _Inout_ void** async_ptr);
+	int getAdvancedHelpForKeywordAsync(_In_ const char* keyword, _In_ void* help_ptr, _In_opt_ AdvancedHelpAsyncCallback callback, _Inout_opt_ void* callback_ctx, _In_opt_ HANDLE event, _Inout_ void** async_ptr);
+
+	void cancelAdvancedHelpAsync(_In_ void* async_ptr);
+	bool isAdvancedHelpAsyncDone(_In_ void* async_ptr);
+
+	int getAdvancedHelpAsyncLoadResult(_In_ void* async_ptr, _Inout_ void** help_ptr);
+	AdvancedHelpStatus getAdvancedHelpAsyncQueryResult(_In_ void* async_ptr, _Out_ char** result_ptr, _Out_opt_ size_t* result_len, _Out_opt_ AdvancedHelpErrorInfo* error_info);
+
+	void freeAdvancedHelpAsync(_Inout_ void** async_ptr);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADVANCED_HELP_ASYNC_H
@@ -0,0 +1,224 @@
+
+/////   INCLUDES   /////
+
+#include "advanced_help_edit.h"
+#include "advanced_help_internal.h"
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+int editAdvancedHelpSubtree(_In_ void* help_ptr, _In_reads_(path_len) const size_t* path, _In_ size_t path_len, _In_opt_ const char* subtree_text, _In_ bool replace);
+int findAdvancedHelpPath(_In_ const AdvancedHelp* help, _In_reads_(path_len) const size_t* path, _In_ size_t path_len, _In_ bool allow_end, _Out_ size_t* index_ptr);
+size_t getAdvancedHelpSubtreeEnd(_In_ const AdvancedHelp* help, _In_ size_t index);
+int checkAdvancedHelpSubtree(_In_ const AdvancedHelp* help, _In_ const char* subtree_text, _In_ size_t base_level, _Out_ size_t* node_count_ptr, _Out_ size_t* text_len_ptr);
+int reserveAdvancedHelpGap(_Inout_ AdvancedHelp* help, _In_ size_t node_count);
+void moveAdvancedHelpGap(_Inout_ AdvancedHelp* help, _In_ size_t index);
+
+
+
+
+/////   FUNCTION IMPLEMENTATIONS   /////
+
+// Inserts the subtree so that its root is found at the path afterwards. The last index of the path may also be the number of children of
+// the parent node, to add the subtree after its last child.
+// Returns 0 on success, -1 if the arguments are wrong or the path is not found, -2 if there is not enough memory,
+// -3 if the subtree text has no nodes, more than one level 0 node, skips levels or goes deeper than the max node level of the help
+int insertAdvancedHelpSubtree(_In_ void* help_ptr, _In_reads_(path_len) const size_t* path, _In_ size_t path_len, _In_ const char* subtree_text) {
+	if (NULL == subtree_text) {
+		return -1;
+	}
+	return editAdvancedHelpSubtree(help_ptr, path, path_len, subtree_text, false);
+}
+
+// Replaces the subtree at the path with a new one. Same errors as insertAdvancedHelpSubtree(). The help is left untouched if an error occurs
+int replaceAdvancedHelpSubtree(_In_ void* help_ptr, _In_reads_(path_len) const size_t* path, _In_ size_t path_len, _In_ const char* subtree_text) {
+	if (NULL == subtree_text) {
+		return -1;
+	}
+	return editAdvancedHelpSubtree(help_ptr, path, path_len, subtree_text, true);
+}
+
+// Returns 0 on success, -1 if the arguments are wrong or the path is not found
+int deleteAdvancedHelpSubtree(_In_ void* help_ptr, _In_reads_(path_len) const size_t* path, _In_ size_t path_len) {
+	return editAdvancedHelpSubtree(help_ptr, path, path_len, NULL, true);
+}
+
+// Removes the subtree at the path if replace is true, and inserts the nodes of subtree_text (if any) in its place.
+// The new text is copied into a chunk of its own (the text the help was loaded from is never modified), and the node table only moves
+// the nodes between its gap and the edited position
+int editAdvancedHelpSubtree(_In_ void* help_ptr, _In_reads_(path_len) const size_t* path, _In_ size_t path_len, _In_opt_ const char* subtree_text, _In_ bool replace) {
+	AdvancedHelp* help = (AdvancedHelp*)help_ptr;
+	if (NULL == help || help->is_wide || NULL == path || 0 == path_len) {
+		return -1;
+	}
+
+	size_t index = 0;
+	if (0 != findAdvancedHelpPath(help, path, path_len, !replace, &index)) {
+		return -1;
+	}
+	size_t deleted_count = replace ? getAdvancedHelpSubtreeEnd(help, index) - index : 0;
+
+	// Get everything that may fail before touching the help
+	size_t base_level = path_len - 1;
+	size_t new_count = 0;
+	AdvancedHelpTextChunk* chunk = NULL;
+	if (NULL != subtree_text) {
+		size_t new_text_len = 0;
+		int error = checkAdvancedHelpSubtree(help, subtree_text, base_level, &new_count, &new_text_len);
+		if (0 != error) {
+			return error;
+		}
+		chunk = (AdvancedHelpTextChunk*)malloc(sizeof(AdvancedHelpTextChunk) + sizeof(char) * (new_text_len + new_count * base_level));
+		countAdvancedHelpAllocation();
+		if (NULL == chunk) {
+			return -2;
+		}
+		if (new_count > deleted_count && 0 != reserveAdvancedHelpGap(help, new_count - deleted_count)) {
+			free(chunk);
+			return -2;
+		}
+	}
+
+	// Deleting the nodes right after the gap only makes the gap bigger
+	moveAdvancedHelpGap(help, index);
+	help->gap_len += deleted_count;
+	help->node_count -= deleted_count;
+
+	if (NULL != chunk) {
+		// Copy the new nodes into the gap, with base_level level chars in front of each one
+		AdvancedHelpNodeIterator iterator;
+		AdvancedHelpNodeRef node;
+		char* chunk_pos = chunk->text;
+		initAdvancedHelpNodeIterator(&iterator, subtree_text, &(help->options));
+		iterator.first_node = false;	// The root is not the first node of the help, so its node start char is removed too
+		while (getNextAdvancedHelpNode(&iterator, &node)) {
+			AdvancedHelpNodeRef* new_node = &(help->nodes[help->gap_start]);
+			memset(chunk_pos, help->options.node_level_char, base_level);
+			memcpy(chunk_pos + base_level, node.text, node.len);
+			new_node->text = chunk_pos;
+			new_node->len = base_level + node.len;
+			new_node->line = 0;
+			new_node->level = base_level + node.level;
+			if (new_node->level > help->max_level) {
+				help->max_level = new_node->level;
+			}
+			chunk_pos += new_node->len;
+			help->gap_start++;
+			help->gap_len--;
+			help->node_count++;
+		}
+		chunk->next = help->added_text;
+		help->added_text = chunk;
+	}
+	help->edited = true;
+
+	// The results in the snapshot are no longer valid
+	freeAdvancedHelpSnapshot(help->snapshot);
+	help->snapshot = NULL;
+	return 0;
+}
+
+// Gets the index in the node table of the node at the path. If allow_end is true, the last index of the path may be the number of
+// children of the parent node (the index is then the end of the subtree of the parent). Returns 0 on success, -1 if the path is not found
+int findAdvancedHelpPath(_In_ const AdvancedHelp* help, _In_reads_(path_len) const size_t* path, _In_ size_t path_len, _In_ bool allow_end, _Out_ size_t* index_ptr) {
+	// The children of the current parent are the nodes of the current level in [begin, end)
+	size_t begin = 0;
+	size_t end = help->node_count;
+	for (size_t level = 0; level < path_len; level++) {
+		size_t child = 0;
+		size_t i = begin;
+		for (; i < end; i++) {
+			if (ADVANCED_HELP_NODE(help, i).level == level) {
+				if (child == path[level]) {
+					break;
+				}
+				child++;
+			}
+		}
+
+		if (i == end) {
+			if (allow_end && level == path_len - 1 && child == path[level]) {
+				*index_ptr = end;
+				return 0;
+			}
+			return -1;
+		}
+		*index_ptr = i;
+		begin = i + 1;
+		end = getAdvancedHelpSubtreeEnd(help, i);
+	}
+	return 0;
+}
+
+// Gets the index of the first node after the subnodes of a node
+size_t getAdvancedHelpSubtreeEnd(_In_ const AdvancedHelp* help, _In_ size_t index) {
+	size_t level = ADVANCED_HELP_NODE(help, index).level;
+	size_t end = index + 1;
+	while (end < help->node_count && ADVANCED_HELP_NODE(help, end).level > level) {
+		end++;
+	}
+	return end;
+}
+
+// Counts the nodes of a subtree text and the length of their text, checking that it is a single well-formed subtree
+// that still fits in the max node level once moved down to base_level. Returns 0 if it is, -3 otherwise
+int checkAdvancedHelpSubtree(_In_ const AdvancedHelp* help, _In_ const char* subtree_text, _In_ size_t base_level, _Out_ size_t* node_count_ptr, _Out_ size_t* text_len_ptr) {
+	AdvancedHelpNodeIterator iterator;
+	AdvancedHelpNodeRef node;
+	size_t previous_level = 0;
+	*node_count_ptr = 0;
+	*text_len_ptr = 0;
+	initAdvancedHelpNodeIterator(&iterator, subtree_text, &(help->options));
+	iterator.first_node = false;
+	while (getNextAdvancedHelpNode(&iterator, &node)) {
+		bool is_root = (0 == *node_count_ptr);
+		if (is_root != (0 == node.level) || node.level > previous_level + 1) {
+			return -3;
+		}
+		if (0 != help->options.max_node_level && base_level + node.level >= help->options.max_node_level) {
+			return -3;
+		}
+		previous_level = node.level;
+		(*node_count_ptr)++;
+		*text_len_ptr += node.len;
+	}
+	return (0 == *node_count_ptr) ? -3 : 0;
+}
+
+// Makes sure the gap can hold node_count more nodes. Returns 0 on success, -2 if there is not enough memory
+int reserveAdvancedHelpGap(_Inout_ AdvancedHelp* help, _In_ size_t node_count) {
+	if (help->gap_len >= node_count) {
+		return 0;
+	}
+
+	size_t new_capacity = (0 == help->node_capacity) ? 64 : help->node_capacity * 2;
+	if (new_capacity < help->node_count + node_count) {
+		new_capacity = help->node_count + node_count;
+	}
+	AdvancedHelpNodeRef* tmp_ptr = (AdvancedHelpNodeRef*)realloc(help->nodes, sizeof(AdvancedHelpNodeRef) * new_capacity);
+	countAdvancedHelpAllocation();
+	if (NULL == tmp_ptr) {
+		return -2;
+	}
+	help->nodes = tmp_ptr;
+
+	// The nodes after the gap go to the end of the new table
+	size_t after_gap = help->node_count - help->gap_start;
+	size_t new_gap_len = new_capacity - help->node_count;
+	memmove(help->nodes + help->gap_start + new_gap_len, help->nodes + help->gap_start + help->gap_len, sizeof(AdvancedHelpNodeRef) * after_gap);
+	help->node_capacity = new_capacity;
+	help->gap_len = new_gap_len;
+	return 0;
+}
+
+// Moves the gap so that it starts right before node index
+void moveAdvancedHelpGap(_Inout_ AdvancedHelp* help, _In_ size_t index) {
+	if (index < help->gap_start) {
+		memmove(help->nodes + index + help->gap_len, help->nodes + index, sizeof(AdvancedHelpNodeRef) * (help->gap_start - index));
+	} else if (index > help->gap_start) {
+		memmove(help->nodes + help->gap_start, help->nodes + help->gap_start + help->gap_len, sizeof(AdvancedHelpNodeRef) * (index - help->gap_start));
+	}
+	help->gap_start = index;
+}
@@ -0,0 +1,34 @@
+#ifndef ADVANCED_HELP_EDIT_H
+#define ADVANCED_HELP_EDIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+	/////   INCLUDES   /////
+#include "advanced_help.h"
+
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+	// Edit a loaded help in place (WCHAR helps are not supported), e.g. to add or remove the sections of a plugin without reloading the whole help.
+	// A path is the position of a node in the tree: path[0] is the index of its level 0 ancestor among the level 0 nodes, path[1] the index of its
+	// level 1 ancestor among the children of that one, and so on (path_len is the level of the node + 1). A subtree is a node and all its subnodes.
+	// The subtree text is formatted like a help file whose first node (and only level 0 node) is the root of the subtree. Its levels are moved down
+	// to the level of the path. Only the edited nodes are parsed or copied, the rest of the help is not.
+	// Editing is not thread-safe: no query may run on the help at the same time, and its open queries (see advancedHelpQueryOpen) must be closed first.
+
+	int insertAdvancedHelpSubtree(_In_ void* help_ptr, _In_reads_(path_len) const size_t* path, _In_ size_t path_len, _In_ const char* subtree_text);
+	int replaceAdvancedHelpSubtree(_In_ void* help_ptr, _In_reads_(path_len) const size_t* path, _In_ size_t path_len, _In_ const char* subtree_text);
+	int deleteAdvancedHelpSubtree(_In_ void* help_ptr, _In_reads_(path_len) const size_t* path, _In_ size_t path_len);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADVANCED_HELP_EDIT_H
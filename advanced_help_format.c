@@ -0,0 +1,408 @@
+
+/////   INCLUDES   /////
+
+#include "advanced_help_format.h"
+#include "advanced_help_internal.h"
+
+#include <io.h>
+#include <stdint.h>
+
+
+
+
+/////   TYPES   /////
+
+// Context of the engine emit callback: forwards every node to the formatter
+typedef struct FormatterEmitContext {
+	const AdvancedHelpFormatter* formatter;
+	const AdvancedHelpSink* sink;
+	const char* keyword;
+	size_t keyword_len;
+	char node_level_char;
+	size_t node_count;
+} FormatterEmitContext;
+
+// Sink wrapper counting the bytes written, only used when the stats are enabled
+typedef struct CountingSinkContext {
+	const AdvancedHelpSink* sink;
+	size_t bytes_written;
+} CountingSinkContext;
+
+// Writes a piece of node text (between keyword occurrences) applying the escaping needed by the output format
+typedef int (*SegmentWriterFn)(_In_ const AdvancedHelpSink* sink, _In_ const char* segment, _In_ size_t len, _In_ size_t level);
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+AdvancedHelpStatus emitNodeToFormatter(_Inout_opt_ void* emit_ctx, _In_ const AdvancedHelpNodeRef* node, _In_opt_ const char* match);
+
+int writeToSink(_In_ const AdvancedHelpSink* sink, _In_ const char* data, _In_ size_t len);
+int writeStrToSink(_In_ const AdvancedHelpSink* sink, _In_ const char* str);
+int writeHighlightedText(_In_ const AdvancedHelpSink* sink, _In_ const AdvancedHelpOutputNode* node, _In_ size_t start, _In_ const char* match_start, _In_ const char* match_end, _In_ SegmentWriterFn write_segment);
+size_t getNodeIndentLen(_In_ const AdvancedHelpOutputNode* node);
+
+int writeRawSegment(_In_ const AdvancedHelpSink* sink, _In_ const char* segment, _In_ size_t len, _In_ size_t level);
+int writeJsonSegment(_In_ const AdvancedHelpSink* sink, _In_ const char* segment, _In_ size_t len, _In_ size_t level);
+int writeMarkdownSegment(_In_ const AdvancedHelpSink* sink, _In_ const char* segment, _In_ size_t len, _In_ size_t level);
+
+int formatPlainNode(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const AdvancedHelpOutputNode* node);
+int formatJsonBegin(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const char* keyword);
+int formatJsonNode(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const AdvancedHelpOutputNode* node);
+int formatJsonEnd(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ size_t node_count);
+int formatMarkdownNode(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const AdvancedHelpOutputNode* node);
+int formatAnsiNode(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const AdvancedHelpOutputNode* node);
+
+int writeToFile(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len);
+int writeToFd(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len);
+int writeToBuffer(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len);
+int writeToCountingSink(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len);
+AdvancedHelpStatus writeAdvancedHelpNodes(_In_ const char* keyword, _In_opt_ const AdvancedHelp* help, _In_ const AdvancedHelpFormatter* formatter, _In_ const AdvancedHelpSink* sink, _Inout_ AdvancedHelpMatchState* state);
+
+
+
+
+/////   GLOBAL VARS   /////
+
+const AdvancedHelpFormatter plain_formatter = { NULL, formatPlainNode, NULL, NULL };
+const AdvancedHelpFormatter json_formatter = { formatJsonBegin, formatJsonNode, formatJsonEnd, NULL };
+const AdvancedHelpFormatter markdown_formatter = { NULL, formatMarkdownNode, NULL, NULL };
+const AdvancedHelpFormatter ansi_formatter = { NULL, formatAnsiNode, NULL, NULL };
+
+
+
+
+/////   FUNCTION IMPLEMENTATIONS   /////
+
+AdvancedHelpStatus writeAdvancedHelpForKeyword(_In_ const char* keyword, _In_ void* help_ptr, _In_ AdvancedHelpOutputFormat format, _In_ AdvancedHelpSink sink) {
+	const AdvancedHelpFormatter* formatter = getAdvancedHelpFormatter(format);
+	if (NULL == formatter) {
+		return ADVANCED_HELP_STATUS_SINK_ERROR;
+	}
+	return writeAdvancedHelpWithFormatter(keyword, help_ptr, formatter, sink);
+}
+
+// Runs the query feeding the nodes to the formatter as soon as they are found
+AdvancedHelpStatus writeAdvancedHelpWithFormatter(_In_ const char* keyword, _In_ void* help_ptr, _In_ const AdvancedHelpFormatter* formatter, _In_ AdvancedHelpSink sink) {
+	const AdvancedHelp* help = (const AdvancedHelp*)help_ptr;
+	AdvancedHelpStatsRecord stats_record;
+	AdvancedHelpMatchState state;
+	AdvancedHelpStatus status = ADVANCED_HELP_STATUS_OK;
+	beginAdvancedHelpQueryStats(&stats_record);
+	initAdvancedHelpMatchState(&state, keyword, (NULL != help) ? help->options.max_node_level : 0);
+
+	if (NULL == stats_record.thread_stats) {
+		status = writeAdvancedHelpNodes(keyword, help, formatter, &sink, &state);
+		freeAdvancedHelpMatchState(&state);
+		return status;
+	}
+
+	CountingSinkContext counting_ctx = { &sink, 0 };
+	AdvancedHelpSink counting_sink = { writeToCountingSink, &counting_ctx };
+	status = writeAdvancedHelpNodes(keyword, help, formatter, &counting_sink, &state);
+	freeAdvancedHelpMatchState(&state);
+	endAdvancedHelpQueryStats(&stats_record, status, state.nodes_scanned, state.nodes_matched, counting_ctx.bytes_written);
+	return status;
+}
+
+const AdvancedHelpFormatter* getAdvancedHelpFormatter(_In_ AdvancedHelpOutputFormat format) {
+	switch (format) {
+	case ADVANCED_HELP_OUTPUT_PLAIN:
+		return &plain_formatter;
+	case ADVANCED_HELP_OUTPUT_JSON:
+		return &json_formatter;
+	case ADVANCED_HELP_OUTPUT_MARKDOWN:
+		return &markdown_formatter;
+	case ADVANCED_HELP_OUTPUT_ANSI:
+		return &ansi_formatter;
+	default:
+		return NULL;
+	}
+}
+
+AdvancedHelpSink getAdvancedHelpFileSink(_In_ FILE* fp) {
+	AdvancedHelpSink sink = { writeToFile, fp };
+	return sink;
+}
+
+AdvancedHelpSink getAdvancedHelpFdSink(_In_ int fd) {
+	AdvancedHelpSink sink = { writeToFd, (void*)(intptr_t)fd };
+	return sink;
+}
+
+// The buffer is filled from buffer_sink->len on. Writing more than it fits is an error (the part that fits is written anyway)
+AdvancedHelpSink getAdvancedHelpBufferSink(_Inout_ AdvancedHelpBufferSink* buffer_sink) {
+	AdvancedHelpSink sink = { writeToBuffer, buffer_sink };
+	return sink;
+}
+
+AdvancedHelpStatus writeAdvancedHelpNodes(_In_ const char* keyword, _In_opt_ const AdvancedHelp* help, _In_ const AdvancedHelpFormatter* formatter, _In_ const AdvancedHelpSink* sink, _Inout_ AdvancedHelpMatchState* state) {
+	if (NULL == help || help->is_wide) {
+		return ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR;
+	}
+	if (NULL == formatter || NULL == formatter->node || NULL == sink->write) {
+		return ADVANCED_HELP_STATUS_SINK_ERROR;
+	}
+	if (&plain_formatter == formatter && '\0' == keyword[0]) {
+		// Same as getAdvancedHelpForKeyword(""): the help text as it is
+		return (0 == writeAdvancedHelpText(help, sink->write, sink->write_ctx)) ? ADVANCED_HELP_STATUS_OK : ADVANCED_HELP_STATUS_SINK_ERROR;
+	}
+
+	if (NULL != formatter->begin && 0 != formatter->begin(formatter->formatter_ctx, sink, keyword)) {
+		return ADVANCED_HELP_STATUS_SINK_ERROR;
+	}
+
+	FormatterEmitContext emit_ctx = { formatter, sink, keyword, strlen(keyword), help->options.node_level_char, 0 };
+	for (size_t i = 0; i < help->node_count; i++) {
+		AdvancedHelpStatus status = matchAdvancedHelpNode(state, &ADVANCED_HELP_NODE(help, i), emitNodeToFormatter, &emit_ctx);
+		if (ADVANCED_HELP_STATUS_OK != status) {
+			return status;
+		}
+	}
+
+	if (NULL != formatter->end && 0 != formatter->end(formatter->formatter_ctx, sink, emit_ctx.node_count)) {
+		return ADVANCED_HELP_STATUS_SINK_ERROR;
+	}
+	return (0 == emit_ctx.node_count) ? ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND : ADVANCED_HELP_STATUS_OK;
+}
+
+AdvancedHelpStatus emitNodeToFormatter(_Inout_opt_ void* emit_ctx, _In_ const AdvancedHelpNodeRef* node, _In_opt_ const char* match) {
+	FormatterEmitContext* ctx = (FormatterEmitContext*)emit_ctx;
+	AdvancedHelpOutputNode output_node;
+	output_node.text = node->text;
+	output_node.len = node->len;
+	output_node.level = node->level;
+	output_node.level_char = ctx->node_level_char;
+	output_node.matched = (NULL != match);
+	output_node.match_offset = (NULL != match) ? (size_t)(match - node->text) : ADVANCED_HELP_NO_MATCH;
+	output_node.keyword = ctx->keyword;
+	output_node.keyword_len = ctx->keyword_len;
+	output_node.index = ctx->node_count;
+
+	if (0 != ctx->formatter->node(ctx->formatter->formatter_ctx, ctx->sink, &output_node)) {
+		return ADVANCED_HELP_STATUS_SINK_ERROR;
+	}
+	ctx->node_count++;
+	return ADVANCED_HELP_STATUS_OK;
+}
+
+int writeToSink(_In_ const AdvancedHelpSink* sink, _In_ const char* data, _In_ size_t len) {
+	if (0 == len) {
+		return 0;
+	}
+	return sink->write(sink->write_ctx, data, len);
+}
+
+int writeStrToSink(_In_ const AdvancedHelpSink* sink, _In_ const char* str) {
+	return writeToSink(sink, str, strlen(str));
+}
+
+// Writes the node text from start on, wrapping every occurrence of the keyword between match_start and match_end.
+// Occurrences are only looked for after the one found by the search, and only in the nodes that matched
+int writeHighlightedText(_In_ const AdvancedHelpSink* sink, _In_ const AdvancedHelpOutputNode* node, _In_ size_t start, _In_ const char* match_start, _In_ const char* match_end, _In_ SegmentWriterFn write_segment) {
+	const char* pos = node->text + start;
+	const char* end = node->text + node->len;
+	const char* match = NULL;
+	if (node->matched && 0 != node->keyword_len) {
+		match = node->text + node->match_offset;
+	}
+
+	while (NULL != match) {
+		if ((0 != write_segment(sink, pos, (size_t)(match - pos), node->level)) ||
+			(0 != writeStrToSink(sink, match_start)) ||
+			(0 != write_segment(sink, match, node->keyword_len, node->level)) ||
+			(0 != writeStrToSink(sink, match_end))) {
+			return -1;
+		}
+		pos = match + node->keyword_len;
+		match = findKeywordInNode(pos, (size_t)(end - pos), node->keyword, node->keyword_len);
+	}
+	return write_segment(sink, pos, (size_t)(end - pos), node->level);
+}
+
+// Number of leading node level chars, which are not written in the formats that show the level in other way.
+// Never goes past the first match, so offsets of the matches are never negative
+size_t getNodeIndentLen(_In_ const AdvancedHelpOutputNode* node) {
+	size_t indent_len = 0;
+	while (indent_len < node->len && node->level_char == node->text[indent_len]) {
+		indent_len++;
+	}
+	if (node->matched && node->match_offset < indent_len) {
+		indent_len = node->match_offset;
+	}
+	return indent_len;
+}
+
+int writeRawSegment(_In_ const AdvancedHelpSink* sink, _In_ const char* segment, _In_ size_t len, _In_ size_t level) {
+	(void)level;
+	return writeToSink(sink, segment, len);
+}
+
+// Escapes quotes, backslashes and control characters. Runs of characters not needing escaping are written at once
+int writeJsonSegment(_In_ const AdvancedHelpSink* sink, _In_ const char* segment, _In_ size_t len, _In_ size_t level) {
+	(void)level;
+	size_t run_start = 0;
+	char escaped[8];
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)segment[i];
+		if (c >= 0x20 && '"' != c && '\\' != c) {
+			continue;
+		}
+		switch (c) {
+		case '"':	strcpy_s(escaped, sizeof(escaped), "\\\""); break;
+		case '\\':	strcpy_s(escaped, sizeof(escaped), "\\\\"); break;
+		case '\n':	strcpy_s(escaped, sizeof(escaped), "\\n"); break;
+		case '\r':	strcpy_s(escaped, sizeof(escaped), "\\r"); break;
+		case '\t':	strcpy_s(escaped, sizeof(escaped), "\\t"); break;
+		default:	snprintf(escaped, sizeof(escaped), "\\u%04x", c); break;
+		}
+		if ((0 != writeToSink(sink, segment + run_start, i - run_start)) || (0 != writeStrToSink(sink, escaped))) {
+			return -1;
+		}
+		run_start = i + 1;
+	}
+	return writeToSink(sink, segment + run_start, len - run_start);
+}
+
+// Multi-line nodes: the following lines are indented so they stay inside the list item
+int writeMarkdownSegment(_In_ const AdvancedHelpSink* sink, _In_ const char* segment, _In_ size_t len, _In_ size_t level) {
+	const char* pos = segment;
+	const char* end = segment + len;
+	const char* new_line = NULL;
+	while (NULL != (new_line = memchr(pos, '\n', (size_t)(end - pos)))) {
+		if ((0 != writeToSink(sink, pos, (size_t)(new_line - pos) + 1))) {
+			return -1;
+		}
+		for (size_t i = 0; i < level + 1; i++) {
+			if (0 != writeToSink(sink, "  ", 2)) {
+				return -1;
+			}
+		}
+		pos = new_line + 1;
+	}
+	return writeToSink(sink, pos, (size_t)(end - pos));
+}
+
+int formatPlainNode(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const AdvancedHelpOutputNode* node) {
+	(void)formatter_ctx;
+	if ((0 != writeToSink(sink, node->text, node->len)) || (0 != writeToSink(sink, "\n", 1))) {
+		return -1;
+	}
+	return 0;
+}
+
+int formatJsonBegin(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const char* keyword) {
+	(void)formatter_ctx;
+	if ((0 != writeStrToSink(sink, "{\"keyword\":\"")) ||
+		(0 != writeJsonSegment(sink, keyword, strlen(keyword), 0)) ||
+		(0 != writeStrToSink(sink, "\",\"nodes\":["))) {
+		return -1;
+	}
+	return 0;
+}
+
+// Offsets in "matches" are relative to "text" (which does not include the leading node level chars)
+int formatJsonNode(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const AdvancedHelpOutputNode* node) {
+	(void)formatter_ctx;
+	char number[32];
+	size_t indent_len = getNodeIndentLen(node);
+
+	snprintf(number, sizeof(number), "%zu", node->level);
+	if ((0 != writeStrToSink(sink, (0 == node->index) ? "{\"level\":" : ",{\"level\":")) ||
+		(0 != writeStrToSink(sink, number)) ||
+		(0 != writeStrToSink(sink, node->matched ? ",\"matched\":true,\"text\":\"" : ",\"matched\":false,\"text\":\"")) ||
+		(0 != writeJsonSegment(sink, node->text + indent_len, node->len - indent_len, node->level)) ||
+		(0 != writeStrToSink(sink, "\",\"matches\":["))) {
+		return -1;
+	}
+
+	if (node->matched && 0 != node->keyword_len) {
+		const char* end = node->text + node->len;
+		const char* match = node->text + node->match_offset;
+		bool first = true;
+		while (NULL != match) {
+			snprintf(number, sizeof(number), first ? "%zu" : ",%zu", (size_t)(match - node->text) - indent_len);
+			if (0 != writeStrToSink(sink, number)) {
+				return -1;
+			}
+			first = false;
+			match += node->keyword_len;
+			match = findKeywordInNode(match, (size_t)(end - match), node->keyword, node->keyword_len);
+		}
+	}
+	return writeStrToSink(sink, "]}");
+}
+
+int formatJsonEnd(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ size_t node_count) {
+	(void)formatter_ctx;
+	(void)node_count;
+	return writeStrToSink(sink, "]}\n");
+}
+
+int formatMarkdownNode(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const AdvancedHelpOutputNode* node) {
+	(void)formatter_ctx;
+	for (size_t i = 0; i < node->level; i++) {
+		if (0 != writeToSink(sink, "  ", 2)) {
+			return -1;
+		}
+	}
+	if ((0 != writeToSink(sink, "- ", 2)) ||
+		(0 != writeHighlightedText(sink, node, getNodeIndentLen(node), "**", "**", writeMarkdownSegment)) ||
+		(0 != writeToSink(sink, "\n", 1))) {
+		return -1;
+	}
+	return 0;
+}
+
+int formatAnsiNode(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const AdvancedHelpOutputNode* node) {
+	(void)formatter_ctx;
+	if ((0 != writeHighlightedText(sink, node, 0, ADVANCED_HELP_ANSI_MATCH_START, ADVANCED_HELP_ANSI_MATCH_END, writeRawSegment)) ||
+		(0 != writeToSink(sink, "\n", 1))) {
+		return -1;
+	}
+	return 0;
+}
+
+int writeToFile(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len) {
+	if (len != fwrite(data, sizeof(char), len, (FILE*)write_ctx)) {
+		return -1;
+	}
+	return 0;
+}
+
+int writeToFd(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len) {
+	int fd = (int)(intptr_t)write_ctx;
+	while (len > 0) {
+		unsigned int chunk = (len > 0x40000000) ? 0x40000000 : (unsigned int)len;
+		int written = _write(fd, data, chunk);
+		if (written <= 0) {
+			return -1;
+		}
+		data += written;
+		len -= (size_t)written;
+	}
+	return 0;
+}
+
+int writeToCountingSink(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len) {
+	CountingSinkContext* counting_ctx = (CountingSinkContext*)write_ctx;
+	int error = counting_ctx->sink->write(counting_ctx->sink->write_ctx, data, len);
+	if (0 == error) {
+		counting_ctx->bytes_written += len;
+	}
+	return error;
+}
+
+int writeToBuffer(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len) {
+	AdvancedHelpBufferSink* buffer_sink = (AdvancedHelpBufferSink*)write_ctx;
+	if (NULL == buffer_sink->buffer || 0 == buffer_sink->size) {
+		return -1;
+	}
+	size_t available = buffer_sink->size - buffer_sink->len - 1;	// - 1 for the final '\0'
+	size_t to_copy = (len > available) ? available : len;
+	memcpy(buffer_sink->buffer + buffer_sink->len, data, to_copy);
+	buffer_sink->len += to_copy;
+	buffer_sink->buffer[buffer_sink->len] = '\0';
+	return (to_copy == len) ? 0 : -1;
+}
@@ -0,0 +1,92 @@
+#ifndef ADVANCED_HELP_FORMAT_H
+#define ADVANCED_HELP_FORMAT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+	/////   INCLUDES   /////
+#include "advanced_help.h"
+
+
+
+
+
+/////   DEFINES   /////
+
+#define ADVANCED_HELP_NO_MATCH ((size_t)-1)
+
+#define ADVANCED_HELP_ANSI_MATCH_START "\x1b[1;31m"
+#define ADVANCED_HELP_ANSI_MATCH_END "\x1b[0m"
+
+
+
+/////   TYPES   /////
+
+	typedef enum AdvancedHelpOutputFormat {
+		ADVANCED_HELP_OUTPUT_PLAIN = 0,		// Same output as getAdvancedHelpForKeyword()
+		ADVANCED_HELP_OUTPUT_JSON,			// {"keyword":"...","nodes":[{"level":0,"matched":true,"text":"...","matches":[0,12]},...]}
+		ADVANCED_HELP_OUTPUT_MARKDOWN,		// Nested list, keyword in bold
+		ADVANCED_HELP_OUTPUT_ANSI			// Plain output with the keyword highlighted with ANSI escape codes
+	} AdvancedHelpOutputFormat;
+
+	// Destination of the output. write must return 0 if all the len bytes were written
+	typedef struct AdvancedHelpSink {
+		int (*write)(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len);
+		void* write_ctx;
+	} AdvancedHelpSink;
+
+	// Caller-supplied fixed size buffer used by getAdvancedHelpBufferSink(). len is the number of bytes written (always null-terminated)
+	typedef struct AdvancedHelpBufferSink {
+		char* buffer;
+		size_t size;
+		size_t len;
+	} AdvancedHelpBufferSink;
+
+	// A node of the result, as produced by the search. The text is NOT null-terminated and it includes the node level chars (level_char).
+	// match_offset is the offset of the first occurrence of the keyword found by the search, or ADVANCED_HELP_NO_MATCH if the node
+	// is shown because of a parent or a subnode (those are not searched). Further occurrences can be found from match_offset + keyword_len
+	typedef struct AdvancedHelpOutputNode {
+		const char* text;
+		size_t len;
+		size_t level;
+		char level_char;	// See AdvancedHelpOptions
+		bool matched;
+		size_t match_offset;
+		const char* keyword;
+		size_t keyword_len;
+		size_t index;	// Position of the node in the result (0 for the first one)
+	} AdvancedHelpOutputNode;
+
+	// Formatter stage: receives the node stream and writes it to the sink. Any non-zero value returned stops the query.
+	// begin and end are optional (may be NULL)
+	typedef struct AdvancedHelpFormatter {
+		int (*begin)(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const char* keyword);
+		int (*node)(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ const AdvancedHelpOutputNode* node);
+		int (*end)(_Inout_opt_ void* formatter_ctx, _In_ const AdvancedHelpSink* sink, _In_ size_t node_count);
+		void* formatter_ctx;
+	} AdvancedHelpFormatter;
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+	// Streams the result of the query straight to the sink: no intermediate string with the whole result is built.
+	// If an error occurs, the nodes already written are kept in the sink. An empty keyword writes every node (the plain format writes
+	// the help text as it is, like getAdvancedHelpForKeyword(""))
+	AdvancedHelpStatus writeAdvancedHelpForKeyword(_In_ const char* keyword, _In_ void* help_ptr, _In_ AdvancedHelpOutputFormat format, _In_ AdvancedHelpSink sink);
+	AdvancedHelpStatus writeAdvancedHelpWithFormatter(_In_ const char* keyword, _In_ void* help_ptr, _In_ const AdvancedHelpFormatter* formatter, _In_ AdvancedHelpSink sink);
+
+	const AdvancedHelpFormatter* getAdvancedHelpFormatter(_In_ AdvancedHelpOutputFormat format);
+
+	AdvancedHelpSink getAdvancedHelpFileSink(_In_ FILE* fp);
+	AdvancedHelpSink getAdvancedHelpFdSink(_In_ int fd);
+	AdvancedHelpSink getAdvancedHelpBufferSink(_Inout_ AdvancedHelpBufferSink* buffer_sink);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADVANCED_HELP_FORMAT_H
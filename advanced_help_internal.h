@@ -0,0 +1,213 @@
+#ifndef ADVANCED_HELP_INTERNAL_H
+#define ADVANCED_HELP_INTERNAL_H
+
+// Internal pieces shared by the advanced help modules (matching engine, node iteration and output buffers).
+// Not part of the public API: may change at any time.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+	/////   INCLUDES   /////
+#include "advanced_help.h"
+#include "advanced_help_stats.h"
+
+
+
+
+
+/////   DEFINES   /////
+
+#define ADVANCED_HELP_NO_FORCED_LEVEL ((size_t)-1)
+
+// Levels of the matching state kept inside the state itself. Deeper helps move them to the heap
+#define ADVANCED_HELP_INLINE_LEVELS 16
+
+// Node i of a char help. The node table is a gap buffer (see AdvancedHelp), so it can not be indexed directly
+#define ADVANCED_HELP_NODE(help, i) ((help)->nodes[((i) < (help)->gap_start) ? (i) : (i) + (help)->gap_len])
+
+
+
+/////   TYPES   /////
+
+	// A node of the help tree as seen by the matching engine.
+	// The text is NOT null-terminated: it points into the help text (or into an interned string) and must not be modified.
+	typedef struct AdvancedHelpNodeRef {
+		const char* text;
+		size_t len;
+		size_t line;	// First line of the node in the help text (1-based), 0 if unknown
+		size_t level;
+	} AdvancedHelpNodeRef;
+
+	// Walks the nodes of a help text without modifying nor copying it
+	typedef struct AdvancedHelpNodeIterator {
+		const char* pos;
+		size_t line;
+		bool first_node;
+		char node_level_char;
+		char node_start_char;
+	} AdvancedHelpNodeIterator;
+
+	// Called for every node that must be shown. Returns ADVANCED_HELP_STATUS_OK to go on or an error to stop the query. match points to the first occurrence of the keyword found by the search, and it is
+	// only set for the node containing the keyword (NULL for its parents and for its subnodes, which are not searched)
+	typedef AdvancedHelpStatus (*AdvancedHelpEmitFn)(_Inout_opt_ void* emit_ctx, _In_ const AdvancedHelpNodeRef* node, _In_opt_ const char* match);
+
+	// A parent node of the current one and whether it was already shown
+	typedef struct AdvancedHelpMatchLevel {
+		AdvancedHelpNodeRef node;
+		bool already_included;
+	} AdvancedHelpMatchLevel;
+
+	// State of the matching algorithm between nodes. levels[0 .. depth - 1] are the current node and its parents.
+	// levels points to inline_levels until a node deeper than ADVANCED_HELP_INLINE_LEVELS is found, so the state must not be copied
+	typedef struct AdvancedHelpMatchState {
+		const char* keyword;
+		size_t keyword_len;
+		size_t max_node_level;
+		AdvancedHelpMatchLevel* levels;
+		size_t depth;
+		size_t capacity;
+		AdvancedHelpMatchLevel inline_levels[ADVANCED_HELP_INLINE_LEVELS];
+		size_t forced_include_min_level;
+		size_t nodes_scanned;
+		size_t nodes_matched;
+	} AdvancedHelpMatchState;
+
+	// Growable output buffer. Unlike strAppendRealloc(), appending does not need to strlen() the whole output each time
+	typedef struct AdvancedHelpBuffer {
+		char* data;
+		size_t len;
+		size_t capacity;
+	} AdvancedHelpBuffer;
+
+	// Receives the help text piece by piece (see writeAdvancedHelpText). Returns 0 to go on or non-zero to stop
+	typedef int (*AdvancedHelpTextWriterFn)(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len);
+
+	// WCHAR versions of the above
+	typedef struct AdvancedHelpNodeRefW {
+		const WCHAR* text;
+		size_t len;
+		size_t line;
+		size_t level;
+	} AdvancedHelpNodeRefW;
+
+	typedef struct AdvancedHelpNodeIteratorW {
+		const WCHAR* pos;
+		size_t line;
+		bool first_node;
+		WCHAR node_level_char;
+		WCHAR node_start_char;
+	} AdvancedHelpNodeIteratorW;
+
+	typedef AdvancedHelpStatus (*AdvancedHelpEmitFnW)(_Inout_opt_ void* emit_ctx, _In_ const AdvancedHelpNodeRefW* node, _In_opt_ const WCHAR* match);
+
+	typedef struct AdvancedHelpMatchLevelW {
+		AdvancedHelpNodeRefW node;
+		bool already_included;
+	} AdvancedHelpMatchLevelW;
+
+	typedef struct AdvancedHelpMatchStateW {
+		const WCHAR* keyword;
+		size_t keyword_len;
+		size_t max_node_level;
+		AdvancedHelpMatchLevelW* levels;
+		size_t depth;
+		size_t capacity;
+		AdvancedHelpMatchLevelW inline_levels[ADVANCED_HELP_INLINE_LEVELS];
+		size_t forced_include_min_level;
+		size_t nodes_scanned;
+		size_t nodes_matched;
+	} AdvancedHelpMatchStateW;
+
+	typedef struct AdvancedHelpBufferW {
+		WCHAR* data;
+		size_t len;
+		size_t capacity;
+	} AdvancedHelpBufferW;
+
+	// Text of the nodes inserted by the edit functions. Chunks are never moved nor modified, so the nodes pointing into them stay valid until the help is freed
+	typedef struct AdvancedHelpTextChunk {
+		struct AdvancedHelpTextChunk* next;
+		char text[];
+	} AdvancedHelpTextChunk;
+
+	// What the help handles (void* help_ptr) point to. The help is split into nodes once, when it is initialized,
+	// so queries only walk the node table. Only one of nodes/nodes_w is used, depending on is_wide.
+	// nodes is a gap buffer of node_capacity entries: nodes[gap_start .. gap_start + gap_len - 1] are unused, so edits only move the nodes between the gap and the edited position
+	typedef struct AdvancedHelp {
+		AdvancedHelpOptions options;
+		bool is_wide;
+		void* text;			// char* or WCHAR*, null-terminated
+		size_t text_len;	// In chars
+		AdvancedHelpNodeRef* nodes;		// Use ADVANCED_HELP_NODE() to get node i
+		AdvancedHelpNodeRefW* nodes_w;	// WCHAR helps can not be edited, so it has no gap
+		size_t node_count;
+		size_t node_capacity;
+		size_t gap_start;
+		size_t gap_len;
+		size_t max_level;	// Deepest node level (after deleting nodes, it may be deeper than the deepest one left)
+		bool edited;		// The nodes no longer match text
+		AdvancedHelpTextChunk* added_text;
+		struct AdvancedHelpSnapshot* snapshot;	// Precomputed results, NULL if no snapshot is loaded
+	} AdvancedHelp;
+
+	// Stats of one query or load in progress. thread_stats is NULL if the stats were disabled when it started
+	typedef struct AdvancedHelpStatsRecord {
+		struct AdvancedHelpThreadStats* thread_stats;
+		LARGE_INTEGER start;
+		unsigned long long allocations_at_start;
+	} AdvancedHelpStatsRecord;
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+	int createAdvancedHelp(_In_ void* text, _In_ bool is_wide, _In_opt_ const AdvancedHelpOptions* options, _Inout_ void** help_ptr);
+	void endAdvancedHelpInitStats(_In_ const AdvancedHelpStatsRecord* record, _In_ int error, _In_opt_ const void* help_ptr);
+	AdvancedHelpStatus queryAdvancedHelp(_In_ const char* keyword, _In_ void* help_ptr, _Out_ char** result_ptr, _Out_opt_ size_t* result_len, _Out_opt_ AdvancedHelpErrorInfo* error_info, _In_opt_ const volatile LONG* cancelled);
+
+	void initAdvancedHelpNodeIterator(_Out_ AdvancedHelpNodeIterator* iterator, _In_ const char* help_text, _In_ const AdvancedHelpOptions* options);
+	bool getNextAdvancedHelpNode(_Inout_ AdvancedHelpNodeIterator* iterator, _Out_ AdvancedHelpNodeRef* node);
+
+	void initAdvancedHelpMatchState(_Out_ AdvancedHelpMatchState* state, _In_ const char* keyword, _In_ size_t max_node_level);
+	void freeAdvancedHelpMatchState(_Inout_ AdvancedHelpMatchState* state);
+	AdvancedHelpStatus matchAdvancedHelpNode(_Inout_ AdvancedHelpMatchState* state, _In_ const AdvancedHelpNodeRef* node, _In_ AdvancedHelpEmitFn emit, _Inout_opt_ void* emit_ctx);
+	const char* findKeywordInNode(_In_ const char* text, _In_ size_t len, _In_ const char* keyword, _In_ size_t keyword_len);
+
+	int appendToAdvancedHelpBuffer(_Inout_ AdvancedHelpBuffer* buffer, _In_ const char* src, _In_ size_t src_len);
+	AdvancedHelpStatus emitNodeToAdvancedHelpBuffer(_Inout_opt_ void* emit_ctx, _In_ const AdvancedHelpNodeRef* node, _In_opt_ const char* match);
+	int writeAdvancedHelpText(_In_ const AdvancedHelp* help, _In_ AdvancedHelpTextWriterFn write, _Inout_opt_ void* write_ctx);
+	int writeToAdvancedHelpBuffer(_Inout_opt_ void* write_ctx, _In_ const char* data, _In_ size_t len);
+	char* copyAdvancedHelpMessage(_In_ const char* message);
+	char* copyAdvancedHelpStatusMessage(_In_ AdvancedHelpStatus status);
+
+	void initAdvancedHelpNodeIteratorW(_Out_ AdvancedHelpNodeIteratorW* iterator, _In_ const WCHAR* help_text, _In_ const AdvancedHelpOptions* options);
+	bool getNextAdvancedHelpNodeW(_Inout_ AdvancedHelpNodeIteratorW* iterator, _Out_ AdvancedHelpNodeRefW* node);
+
+	void initAdvancedHelpMatchStateW(_Out_ AdvancedHelpMatchStateW* state, _In_ const WCHAR* keyword, _In_ size_t max_node_level);
+	void freeAdvancedHelpMatchStateW(_Inout_ AdvancedHelpMatchStateW* state);
+	AdvancedHelpStatus matchAdvancedHelpNodeW(_Inout_ AdvancedHelpMatchStateW* state, _In_ const AdvancedHelpNodeRefW* node, _In_ AdvancedHelpEmitFnW emit, _Inout_opt_ void* emit_ctx);
+	const WCHAR* findKeywordInNodeW(_In_ const WCHAR* text, _In_ size_t len, _In_ const WCHAR* keyword, _In_ size_t keyword_len);
+
+	int appendToAdvancedHelpBufferW(_Inout_ AdvancedHelpBufferW* buffer, _In_ const WCHAR* src, _In_ size_t src_len);
+	AdvancedHelpStatus emitNodeToAdvancedHelpBufferW(_Inout_opt_ void* emit_ctx, _In_ const AdvancedHelpNodeRefW* node, _In_opt_ const WCHAR* match);
+	WCHAR* copyAdvancedHelpMessageW(_In_ const WCHAR* message);
+	WCHAR* copyAdvancedHelpStatusMessageW(_In_ AdvancedHelpStatus status);
+
+	bool findAdvancedHelpSnapshotResult(_In_ const struct AdvancedHelpSnapshot* snapshot, _In_ const char* keyword, _Out_ AdvancedHelpStatus* status_ptr, _Inout_ AdvancedHelpBuffer* result, _Out_opt_ AdvancedHelpErrorInfo* error_info);
+	void freeAdvancedHelpSnapshot(_In_opt_ struct AdvancedHelpSnapshot* snapshot);
+
+	void beginAdvancedHelpQueryStats(_Out_ AdvancedHelpStatsRecord* record);
+	void endAdvancedHelpQueryStats(_In_ const AdvancedHelpStatsRecord* record, _In_ AdvancedHelpStatus status, _In_ size_t nodes_scanned, _In_ size_t nodes_matched, _In_ size_t bytes_emitted);
+	void beginAdvancedHelpLoadStats(_Out_ AdvancedHelpStatsRecord* record);
+	void endAdvancedHelpLoadStats(_In_ const AdvancedHelpStatsRecord* record, _In_ bool success, _In_ size_t bytes_loaded, _In_ size_t nodes_loaded, _In_ size_t max_depth);
+	void countAdvancedHelpAllocation();
+	void countAdvancedHelpCacheHit();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADVANCED_HELP_INTERNAL_H
@@ -0,0 +1,166 @@
+
+/////   INCLUDES   /////
+
+#include "advanced_help_query.h"
+#include "advanced_help_internal.h"
+
+
+
+
+/////   TYPES   /////
+
+typedef struct AdvancedHelpQuery {
+	const AdvancedHelp* help;
+	size_t next_node;
+	AdvancedHelpMatchState state;
+
+	// Nodes already emitted by the engine but not returned yet (a match emits the node and all its parents at once, which may not fit in the page)
+	AdvancedHelpNodeRef* pending_nodes;
+	size_t pending_start;
+	size_t pending_count;
+	size_t pending_capacity;
+
+	AdvancedHelpStatus error;
+	bool found;		// Some page was returned already
+	char keyword[];
+} AdvancedHelpQuery;
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+AdvancedHelpStatus emitNodeToQueryPending(_Inout_opt_ void* emit_ctx, _In_ const AdvancedHelpNodeRef* node, _In_opt_ const char* match);
+
+
+
+
+/////   FUNCTION IMPLEMENTATIONS   /////
+
+// Starts a query. No node is searched until advancedHelpQueryNext() is called.
+// Returns 0 on success, -1 if already initialized, -2 if there is not enough memory, ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR if help_ptr is NULL (or a WCHAR help)
+int advancedHelpQueryOpen(_In_ const char* keyword, _In_ void* help_ptr, _Inout_ void** query_ptr) {
+	const AdvancedHelp* help = (const AdvancedHelp*)help_ptr;
+	if (NULL == query_ptr || NULL != *query_ptr || NULL == keyword) {
+		return -1;
+	}
+	if (NULL == help || help->is_wide) {
+		return ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR;
+	}
+
+	size_t keyword_len = strlen(keyword);
+	AdvancedHelpQuery* query = (AdvancedHelpQuery*)malloc(sizeof(AdvancedHelpQuery) + keyword_len + 1);
+	if (NULL == query) {
+		return -2;
+	}
+	memcpy(query->keyword, keyword, keyword_len + 1);
+	query->help = help;
+	query->next_node = 0;
+	initAdvancedHelpMatchState(&(query->state), query->keyword, help->options.max_node_level);
+	query->pending_nodes = NULL;
+	query->pending_start = 0;
+	query->pending_count = 0;
+	query->pending_capacity = 0;
+	query->error = ADVANCED_HELP_STATUS_OK;
+	query->found = false;
+
+	*query_ptr = query;
+	return 0;
+}
+
+// Retrieves the next page of the result (same format as getAdvancedHelpForKeyword), with at most max_nodes nodes and max_bytes chars
+// (0 means no limit). A page always has at least one node, even if it is longer than max_bytes.
+// When there are no more nodes, *page_ptr is set to NULL. The returned page must be freed by function caller.
+// Returns ADVANCED_HELP_STATUS_OK, ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND if the search ends without any node to show, or an error status
+// (once a status other than OK is returned, it is returned by all the following calls)
+AdvancedHelpStatus advancedHelpQueryNext(_In_ void* query_ptr, _In_ size_t max_nodes, _In_ size_t max_bytes, _Out_ char** page_ptr) {
+	*page_ptr = NULL;
+	AdvancedHelpQuery* query = (AdvancedHelpQuery*)query_ptr;
+	if (NULL == query) {
+		return ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR;
+	}
+	if (ADVANCED_HELP_STATUS_OK != query->error) {
+		return query->error;
+	}
+
+	AdvancedHelpStatsRecord stats_record;
+	size_t nodes_scanned_at_start = query->state.nodes_scanned;
+	size_t nodes_matched_at_start = query->state.nodes_matched;
+	beginAdvancedHelpQueryStats(&stats_record);
+
+	AdvancedHelpBuffer page = { 0 };
+	size_t page_node_count = 0;
+	while (0 == max_nodes || page_node_count < max_nodes) {
+		// Resume the search until some node must be shown
+		if (query->pending_start == query->pending_count) {
+			query->pending_start = 0;
+			query->pending_count = 0;
+			if (query->next_node == query->help->node_count) {
+				break;
+			}
+			AdvancedHelpStatus status = matchAdvancedHelpNode(&(query->state), &ADVANCED_HELP_NODE(query->help, query->next_node), emitNodeToQueryPending, query);
+			query->next_node++;
+			if (ADVANCED_HELP_STATUS_OK != status) {
+				query->error = status;
+				free(page.data);
+				endAdvancedHelpQueryStats(&stats_record, status, query->state.nodes_scanned - nodes_scanned_at_start, query->state.nodes_matched - nodes_matched_at_start, 0);
+				return query->error;
+			}
+			continue;
+		}
+
+		const AdvancedHelpNodeRef* pending_node = &(query->pending_nodes[query->pending_start]);
+		if (0 != max_bytes && 0 != page_node_count && page.len + pending_node->len + 1 > max_bytes) {
+			break;
+		}
+		if ((0 != appendToAdvancedHelpBuffer(&page, pending_node->text, pending_node->len)) || (0 != appendToAdvancedHelpBuffer(&page, "\n", 1))) {
+			query->error = ADVANCED_HELP_STATUS_NOMEM_ERROR;
+			free(page.data);
+			endAdvancedHelpQueryStats(&stats_record, ADVANCED_HELP_STATUS_NOMEM_ERROR, query->state.nodes_scanned - nodes_scanned_at_start, query->state.nodes_matched - nodes_matched_at_start, 0);
+			return query->error;
+		}
+		query->pending_start++;
+		page_node_count++;
+	}
+
+	// Reaching the end is only a miss if no page was returned before
+	if (NULL != page.data) {
+		query->found = true;
+	} else if (!query->found) {
+		query->error = ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND;
+	}
+	endAdvancedHelpQueryStats(&stats_record, query->found ? ADVANCED_HELP_STATUS_OK : ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND,
+		query->state.nodes_scanned - nodes_scanned_at_start, query->state.nodes_matched - nodes_matched_at_start, page.len);
+
+	*page_ptr = page.data;
+	return query->error;
+}
+
+void advancedHelpQueryClose(_In_ void** query_ptr) {
+	if (NULL != query_ptr && NULL != *query_ptr) {
+		AdvancedHelpQuery* query = (AdvancedHelpQuery*)*query_ptr;
+		freeAdvancedHelpMatchState(&(query->state));
+		free(query->pending_nodes);
+		free(query);
+		*query_ptr = NULL;
+	}
+}
+
+// The engine emits at most one node per level for each node processed, and it is only called when there are no pending nodes
+AdvancedHelpStatus emitNodeToQueryPending(_Inout_opt_ void* emit_ctx, _In_ const AdvancedHelpNodeRef* node, _In_opt_ const char* match) {
+	(void)match;
+	AdvancedHelpQuery* query = (AdvancedHelpQuery*)emit_ctx;
+	if (query->pending_count == query->pending_capacity) {
+		size_t new_capacity = (0 == query->pending_capacity) ? ADVANCED_HELP_INLINE_LEVELS : query->pending_capacity * 2;
+		AdvancedHelpNodeRef* tmp_ptr = (AdvancedHelpNodeRef*)realloc(query->pending_nodes, sizeof(AdvancedHelpNodeRef) * new_capacity);
+		countAdvancedHelpAllocation();
+		if (NULL == tmp_ptr) {
+			return ADVANCED_HELP_STATUS_NOMEM_ERROR;
+		}
+		query->pending_nodes = tmp_ptr;
+		query->pending_capacity = new_capacity;
+	}
+	query->pending_nodes[query->pending_count] = *node;
+	query->pending_count++;
+	return ADVANCED_HELP_STATUS_OK;
+}
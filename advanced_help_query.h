@@ -0,0 +1,32 @@
+#ifndef ADVANCED_HELP_QUERY_H
+#define ADVANCED_HELP_QUERY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+	/////   INCLUDES   /////
+#include "advanced_help.h"
+
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+	// Cursor over the result of a query. Instead of building the whole result at once, every call to advancedHelpQueryNext() resumes
+	// the search where the previous one stopped and returns only the next page, so memory is bounded by the page size.
+	// The help must not be freed while the query is open. An empty keyword pages every node (one per line, without the node
+	// start chars, and with the levels checked), not the help text as it is like getAdvancedHelpForKeyword("").
+
+	int advancedHelpQueryOpen(_In_ const char* keyword, _In_ void* help_ptr, _Inout_ void** query_ptr);
+	AdvancedHelpStatus advancedHelpQueryNext(_In_ void* query_ptr, _In_ size_t max_nodes, _In_ size_t max_bytes, _Out_ char** page_ptr);
+	void advancedHelpQueryClose(_In_ void** query_ptr);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADVANCED_HELP_QUERY_H
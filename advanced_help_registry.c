@@ -0,0 +1,451 @@
+
+/////   INCLUDES   /////
+
+#include "advanced_help_registry.h"
+#include "advanced_help_internal.h"
+
+
+
+
+/////   TYPES   /////
+
+// Node text shared by all the manuals of a registry. Content-addressed: two nodes with the same text use the same AdvancedHelpInternedText
+typedef struct AdvancedHelpInternedText {
+	size_t hash;
+	size_t refcount;
+	size_t len;
+	char text[];	// Null-terminated
+} AdvancedHelpInternedText;
+
+typedef struct AdvancedHelpRegistryNode {
+	AdvancedHelpInternedText* text;
+	size_t level;
+} AdvancedHelpRegistryNode;
+
+typedef struct AdvancedHelpRegistryManual {
+	char* name;
+	char* locale;
+	AdvancedHelpRegistryNode* nodes;
+	size_t node_count;
+	size_t max_node_level;	// From the options of the help added
+} AdvancedHelpRegistryManual;
+
+typedef struct AdvancedHelpRegistry {
+	AdvancedHelpRegistryManual* manuals;
+	size_t manual_count;
+	size_t manual_capacity;
+
+	// String pool: open addressing hash table (linear probing). Removed texts leave a tombstone so probing chains are not broken
+	AdvancedHelpInternedText** pool_slots;
+	size_t pool_slot_count;		// Always a power of 2
+	size_t pool_used_slots;		// Live texts + tombstones
+} AdvancedHelpRegistry;
+
+
+
+
+/////   GLOBAL VARS   /////
+
+char registry_tombstone_marker = 0;
+#define REGISTRY_TOMBSTONE ((AdvancedHelpInternedText*)&registry_tombstone_marker)
+
+#define REGISTRY_INITIAL_POOL_SLOTS 1024
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+size_t hashRegistryText(_In_ const char* text, _In_ size_t len);
+AdvancedHelpInternedText* internRegistryText(_Inout_ AdvancedHelpRegistry* registry, _In_ const char* text, _In_ size_t len);
+void releaseRegistryText(_Inout_ AdvancedHelpRegistry* registry, _In_ AdvancedHelpInternedText* interned);
+int growRegistryPool(_Inout_ AdvancedHelpRegistry* registry);
+void freeRegistryManual(_Inout_ AdvancedHelpRegistry* registry, _Inout_ AdvancedHelpRegistryManual* manual);
+AdvancedHelpRegistryManual* findRegistryManualByName(_In_ AdvancedHelpRegistry* registry, _In_ const char* name);
+AdvancedHelpRegistryManual* findRegistryManualByLocale(_In_ AdvancedHelpRegistry* registry, _In_ const char* locale);
+char* queryRegistryManual(_In_ const char* keyword, _In_opt_ AdvancedHelpRegistryManual* manual);
+char* copyRegistryString(_In_opt_ const char* src);
+
+
+
+
+/////   FUNCTION IMPLEMENTATIONS   /////
+
+int initAdvancedHelpRegistry(_Inout_ void** registry_ptr) {
+	// Check if already initialized
+	if (NULL == registry_ptr || NULL != *registry_ptr) {
+		return -1;
+	}
+
+	AdvancedHelpRegistry* registry = (AdvancedHelpRegistry*)calloc(1, sizeof(AdvancedHelpRegistry));
+	if (NULL == registry) {
+		return -2;
+	}
+	registry->pool_slots = (AdvancedHelpInternedText**)calloc(REGISTRY_INITIAL_POOL_SLOTS, sizeof(AdvancedHelpInternedText*));
+	if (NULL == registry->pool_slots) {
+		free(registry);
+		return -2;
+	}
+	registry->pool_slot_count = REGISTRY_INITIAL_POOL_SLOTS;
+
+	*registry_ptr = registry;
+	return 0;
+}
+
+void freeAdvancedHelpRegistry(_In_ void** registry_ptr) {
+	if (NULL == registry_ptr || NULL == *registry_ptr) {
+		return;
+	}
+	AdvancedHelpRegistry* registry = (AdvancedHelpRegistry*)*registry_ptr;
+
+	for (size_t i = 0; i < registry->manual_count; i++) {
+		freeRegistryManual(registry, &(registry->manuals[i]));
+	}
+	free(registry->manuals);
+
+	// All texts have already been released by their manuals, only tombstones (not allocated) may remain
+	free(registry->pool_slots);
+	free(registry);
+	*registry_ptr = NULL;
+}
+
+// Adds a copy of an already initialized help (see initAdvancedHelp, WCHAR helps are not supported) to the registry. The help may be freed afterwards.
+// Returns 0 on success, -1 if the arguments are wrong or the name is already in use, -2 if there is not enough memory
+int addAdvancedHelpToRegistry(_In_ void* registry_ptr, _In_ const char* name, _In_opt_ const char* locale, _In_ void* help_ptr) {
+	AdvancedHelpRegistry* registry = (AdvancedHelpRegistry*)registry_ptr;
+	const AdvancedHelp* help = (const AdvancedHelp*)help_ptr;
+	if (NULL == registry || NULL == name || NULL == help || help->is_wide) {
+		return -1;
+	}
+	if (NULL != findRegistryManualByName(registry, name)) {
+		return -1;
+	}
+
+	if (registry->manual_count == registry->manual_capacity) {
+		size_t new_capacity = (0 == registry->manual_capacity) ? 4 : registry->manual_capacity * 2;
+		AdvancedHelpRegistryManual* tmp_ptr = (AdvancedHelpRegistryManual*)realloc(registry->manuals, sizeof(AdvancedHelpRegistryManual) * new_capacity);
+		if (NULL == tmp_ptr) {
+			return -2;
+		}
+		registry->manuals = tmp_ptr;
+		registry->manual_capacity = new_capacity;
+	}
+
+	AdvancedHelpRegistryManual manual = { 0 };
+	int error = 0;
+
+	manual.name = copyRegistryString(name);
+	manual.locale = copyRegistryString(locale);
+	if (NULL == manual.name || (NULL != locale && NULL == manual.locale)) {
+		error = -2;
+		goto ADD_MANUAL_ERROR_LABEL;
+	}
+
+	// Intern the text of every node
+	manual.max_node_level = help->options.max_node_level;
+	if (0 != help->node_count) {
+		manual.nodes = (AdvancedHelpRegistryNode*)malloc(sizeof(AdvancedHelpRegistryNode) * help->node_count);
+		if (NULL == manual.nodes) {
+			error = -2;
+			goto ADD_MANUAL_ERROR_LABEL;
+		}
+	}
+	for (size_t i = 0; i < help->node_count; i++) {
+		const AdvancedHelpNodeRef* node = &ADVANCED_HELP_NODE(help, i);
+		AdvancedHelpInternedText* interned = internRegistryText(registry, node->text, node->len);
+		if (NULL == interned) {
+			error = -2;
+			goto ADD_MANUAL_ERROR_LABEL;
+		}
+		manual.nodes[manual.node_count].text = interned;
+		manual.nodes[manual.node_count].level = node->level;
+		manual.node_count++;
+	}
+
+	registry->manuals[registry->manual_count] = manual;
+	registry->manual_count++;
+	return 0;
+
+ADD_MANUAL_ERROR_LABEL:
+	freeRegistryManual(registry, &manual);
+	return error;
+}
+
+// Same as addAdvancedHelpToRegistry(), reading the help from a file. Returns also the errors of initAdvancedHelp
+int loadAdvancedHelpIntoRegistry(_In_ void* registry_ptr, _In_ const char* name, _In_opt_ const char* locale, _In_ const char* help_filename) {
+	void* help_ptr = NULL;
+	int error = initAdvancedHelp(help_filename, &help_ptr);
+	if (0 != error) {
+		return error;
+	}
+	error = addAdvancedHelpToRegistry(registry_ptr, name, locale, help_ptr);
+	freeAdvancedHelp(&help_ptr);
+	return error;
+}
+
+int removeAdvancedHelpFromRegistry(_In_ void* registry_ptr, _In_ const char* name) {
+	AdvancedHelpRegistry* registry = (AdvancedHelpRegistry*)registry_ptr;
+	if (NULL == registry || NULL == name) {
+		return -1;
+	}
+	AdvancedHelpRegistryManual* manual = findRegistryManualByName(registry, name);
+	if (NULL == manual) {
+		return -1;
+	}
+
+	freeRegistryManual(registry, manual);
+	size_t index = (size_t)(manual - registry->manuals);
+	memmove(manual, manual + 1, sizeof(AdvancedHelpRegistryManual) * (registry->manual_count - index - 1));
+	registry->manual_count--;
+	return 0;
+}
+
+// Same as getAdvancedHelpForKeyword() on the manual registered with that name.
+// An empty keyword shows every node of the manual (not its text as it was loaded). The returned pointer must be freed by function caller
+char* getAdvancedHelpForKeywordByName(_In_ const char* keyword, _In_ void* registry_ptr, _In_ const char* name) {
+	if (NULL == registry_ptr || NULL == name) {
+		return copyAdvancedHelpMessage(ADVANCED_HELP_UNINITIALIZED_ERROR);
+	}
+	return queryRegistryManual(keyword, findRegistryManualByName((AdvancedHelpRegistry*)registry_ptr, name));
+}
+
+// Same as getAdvancedHelpForKeywordByName(), using the first manual registered with that locale (e.g. "es_ES").
+// If there is none, the first manual with the same language (e.g. "es" or "es_MX") is used
+char* getAdvancedHelpForKeywordByLocale(_In_ const char* keyword, _In_ void* registry_ptr, _In_ const char* locale) {
+	if (NULL == registry_ptr || NULL == locale) {
+		return copyAdvancedHelpMessage(ADVANCED_HELP_UNINITIALIZED_ERROR);
+	}
+	return queryRegistryManual(keyword, findRegistryManualByLocale((AdvancedHelpRegistry*)registry_ptr, locale));
+}
+
+// Queries several manuals at once: results[i] gets the result for names[i] (as in getAdvancedHelpForKeywordByName).
+// Every results[i] must be freed by function caller. Returns 0 if all the results could be retrieved, -2 if any of them is NULL due to lack of memory
+int getAdvancedHelpForKeywordMulti(_In_ const char* keyword, _In_ void* registry_ptr, _In_reads_(count) const char* const* names, _In_ size_t count, _Out_writes_(count) char** results) {
+	int error = 0;
+	for (size_t i = 0; i < count; i++) {
+		results[i] = getAdvancedHelpForKeywordByName(keyword, registry_ptr, names[i]);
+		if (NULL == results[i]) {
+			error = -2;
+		}
+	}
+	return error;
+}
+
+// Gets the bytes of node text actually stored by the registry (unique_bytes) and the bytes that the same manuals would need
+// if each of them had its own copy (referenced_bytes)
+void getAdvancedHelpRegistryTextBytes(_In_ void* registry_ptr, _Out_opt_ size_t* unique_bytes, _Out_opt_ size_t* referenced_bytes) {
+	AdvancedHelpRegistry* registry = (AdvancedHelpRegistry*)registry_ptr;
+	size_t unique = 0;
+	size_t referenced = 0;
+	if (NULL != registry) {
+		for (size_t i = 0; i < registry->pool_slot_count; i++) {
+			if (NULL != registry->pool_slots[i] && REGISTRY_TOMBSTONE != registry->pool_slots[i]) {
+				unique += registry->pool_slots[i]->len;
+			}
+		}
+		for (size_t i = 0; i < registry->manual_count; i++) {
+			for (size_t j = 0; j < registry->manuals[i].node_count; j++) {
+				referenced += registry->manuals[i].nodes[j].text->len;
+			}
+		}
+	}
+	if (NULL != unique_bytes) {
+		*unique_bytes = unique;
+	}
+	if (NULL != referenced_bytes) {
+		*referenced_bytes = referenced;
+	}
+}
+
+// FNV-1a
+size_t hashRegistryText(_In_ const char* text, _In_ size_t len) {
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char)text[i];
+		hash *= 1099511628211ULL;
+	}
+	return (size_t)hash;
+}
+
+// Returns the pooled copy of the text (adding it if needed) with one more reference, or NULL if there is not enough memory
+AdvancedHelpInternedText* internRegistryText(_Inout_ AdvancedHelpRegistry* registry, _In_ const char* text, _In_ size_t len) {
+	// Keep the load factor below 3/4 (tombstones included)
+	if ((registry->pool_used_slots + 1) * 4 > registry->pool_slot_count * 3) {
+		if (0 != growRegistryPool(registry)) {
+			return NULL;
+		}
+	}
+
+	size_t hash = hashRegistryText(text, len);
+	size_t mask = registry->pool_slot_count - 1;
+	size_t free_slot = registry->pool_slot_count;	// First tombstone found, reused if the text is not in the pool
+	for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+		AdvancedHelpInternedText* slot = registry->pool_slots[i];
+		if (NULL == slot) {
+			if (registry->pool_slot_count == free_slot) {
+				free_slot = i;
+			}
+			break;
+		}
+		if (REGISTRY_TOMBSTONE == slot) {
+			if (registry->pool_slot_count == free_slot) {
+				free_slot = i;
+			}
+			continue;
+		}
+		if (slot->hash == hash && slot->len == len && 0 == memcmp(slot->text, text, len)) {
+			slot->refcount++;
+			return slot;
+		}
+	}
+
+	AdvancedHelpInternedText* interned = (AdvancedHelpInternedText*)malloc(sizeof(AdvancedHelpInternedText) + len + 1);
+	if (NULL == interned) {
+		return NULL;
+	}
+	interned->hash = hash;
+	interned->refcount = 1;
+	interned->len = len;
+	memcpy(interned->text, text, len);
+	interned->text[len] = '\0';
+
+	if (NULL == registry->pool_slots[free_slot]) {
+		registry->pool_used_slots++;
+	}
+	registry->pool_slots[free_slot] = interned;
+	return interned;
+}
+
+// Drops one reference to the text, removing it from the pool when no manual uses it
+void releaseRegistryText(_Inout_ AdvancedHelpRegistry* registry, _In_ AdvancedHelpInternedText* interned) {
+	interned->refcount--;
+	if (0 != interned->refcount) {
+		return;
+	}
+
+	size_t mask = registry->pool_slot_count - 1;
+	for (size_t i = interned->hash & mask; NULL != registry->pool_slots[i]; i = (i + 1) & mask) {
+		if (interned == registry->pool_slots[i]) {
+			registry->pool_slots[i] = REGISTRY_TOMBSTONE;
+			break;
+		}
+	}
+	free(interned);
+}
+
+// Rehashes the pool into a bigger table (or the same size if it is mostly tombstones). Returns 0 on success, -1 if there is not enough memory
+int growRegistryPool(_Inout_ AdvancedHelpRegistry* registry) {
+	size_t live_count = 0;
+	for (size_t i = 0; i < registry->pool_slot_count; i++) {
+		if (NULL != registry->pool_slots[i] && REGISTRY_TOMBSTONE != registry->pool_slots[i]) {
+			live_count++;
+		}
+	}
+	size_t new_slot_count = registry->pool_slot_count;
+	while ((live_count + 1) * 2 > new_slot_count) {
+		new_slot_count *= 2;
+	}
+
+	AdvancedHelpInternedText** new_slots = (AdvancedHelpInternedText**)calloc(new_slot_count, sizeof(AdvancedHelpInternedText*));
+	if (NULL == new_slots) {
+		return -1;
+	}
+	size_t mask = new_slot_count - 1;
+	for (size_t i = 0; i < registry->pool_slot_count; i++) {
+		AdvancedHelpInternedText* slot = registry->pool_slots[i];
+		if (NULL == slot || REGISTRY_TOMBSTONE == slot) {
+			continue;
+		}
+		size_t j = slot->hash & mask;
+		while (NULL != new_slots[j]) {
+			j = (j + 1) & mask;
+		}
+		new_slots[j] = slot;
+	}
+
+	free(registry->pool_slots);
+	registry->pool_slots = new_slots;
+	registry->pool_slot_count = new_slot_count;
+	registry->pool_used_slots = live_count;
+	return 0;
+}
+
+void freeRegistryManual(_Inout_ AdvancedHelpRegistry* registry, _Inout_ AdvancedHelpRegistryManual* manual) {
+	for (size_t i = 0; i < manual->node_count; i++) {
+		releaseRegistryText(registry, manual->nodes[i].text);
+	}
+	free(manual->nodes);
+	free(manual->name);
+	free(manual->locale);
+	manual->nodes = NULL;
+	manual->node_count = 0;
+	manual->name = NULL;
+	manual->locale = NULL;
+}
+
+AdvancedHelpRegistryManual* findRegistryManualByName(_In_ AdvancedHelpRegistry* registry, _In_ const char* name) {
+	for (size_t i = 0; i < registry->manual_count; i++) {
+		if (0 == strcmp(registry->manuals[i].name, name)) {
+			return &(registry->manuals[i]);
+		}
+	}
+	return NULL;
+}
+
+AdvancedHelpRegistryManual* findRegistryManualByLocale(_In_ AdvancedHelpRegistry* registry, _In_ const char* locale) {
+	for (size_t i = 0; i < registry->manual_count; i++) {
+		if (NULL != registry->manuals[i].locale && 0 == strcmp(registry->manuals[i].locale, locale)) {
+			return &(registry->manuals[i]);
+		}
+	}
+
+	// Fall back to the language (the part before the territory, codeset or modifier: "es" in "es_ES.UTF-8")
+	size_t language_len = strcspn(locale, "_-.@");
+	for (size_t i = 0; i < registry->manual_count; i++) {
+		const char* manual_locale = registry->manuals[i].locale;
+		if (NULL != manual_locale && language_len == strcspn(manual_locale, "_-.@") && 0 == strncmp(manual_locale, locale, language_len)) {
+			return &(registry->manuals[i]);
+		}
+	}
+	return NULL;
+}
+
+// Runs the query on the nodes of the manual. The returned pointer must be freed by function caller
+char* queryRegistryManual(_In_ const char* keyword, _In_opt_ AdvancedHelpRegistryManual* manual) {
+	if (NULL == manual) {
+		return copyAdvancedHelpMessage(ADVANCED_HELP_MANUAL_NOT_FOUND_INFO);
+	}
+
+	AdvancedHelpStatsRecord stats_record;
+	AdvancedHelpBuffer help_to_show = { 0 };
+	AdvancedHelpMatchState state;
+	AdvancedHelpNodeRef node;
+	AdvancedHelpStatus status = ADVANCED_HELP_STATUS_OK;
+	beginAdvancedHelpQueryStats(&stats_record);
+	initAdvancedHelpMatchState(&state, keyword, manual->max_node_level);
+	for (size_t i = 0; i < manual->node_count && ADVANCED_HELP_STATUS_OK == status; i++) {
+		node.text = manual->nodes[i].text->text;
+		node.len = manual->nodes[i].text->len;
+		node.level = manual->nodes[i].level;
+		node.line = 0;
+		status = matchAdvancedHelpNode(&state, &node, emitNodeToAdvancedHelpBuffer, &help_to_show);
+	}
+	freeAdvancedHelpMatchState(&state);
+	if (ADVANCED_HELP_STATUS_OK == status && NULL == help_to_show.data) {
+		status = ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND;
+	}
+	endAdvancedHelpQueryStats(&stats_record, status, state.nodes_scanned, state.nodes_matched, (ADVANCED_HELP_STATUS_OK == status) ? help_to_show.len : 0);
+
+	if (ADVANCED_HELP_STATUS_OK == status) {
+		return help_to_show.data;
+	}
+	free(help_to_show.data);
+	return copyAdvancedHelpStatusMessage(status);
+}
+
+char* copyRegistryString(_In_opt_ const char* src) {
+	if (NULL == src) {
+		return NULL;
+	}
+	return copyAdvancedHelpMessage(src);
+}
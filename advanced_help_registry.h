@@ -0,0 +1,49 @@
+#ifndef ADVANCED_HELP_REGISTRY_H
+#define ADVANCED_HELP_REGISTRY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+	/////   INCLUDES   /////
+#include "advanced_help.h"
+
+
+
+
+
+/////   DEFINES   /////
+
+#define ADVANCED_HELP_MANUAL_NOT_FOUND_INFO "ADVANCED HELP INFO: the help manual requested could not be found.\n"
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+	// A registry holds several help manuals (e.g. the same manual in several languages and product variants) identified by name and,
+	// optionally, by locale. The text of every node is interned in a pool shared by all the manuals, so identical nodes are stored only once
+	// and near-identical variants only cost their different nodes (plus a small node table).
+	// The registry is not thread-safe: adding or removing manuals must not happen at the same time as queries.
+	// Queries give the same result as getAdvancedHelpForKeyword() on the manual, except for an empty keyword: every node is shown
+	// (one per line, without the node start chars, and with the levels checked) instead of the help text as it was loaded.
+
+	int initAdvancedHelpRegistry(_Inout_ void** registry_ptr);
+	void freeAdvancedHelpRegistry(_In_ void** registry_ptr);
+
+	int addAdvancedHelpToRegistry(_In_ void* registry_ptr, _In_ const char* name, _In_opt_ const char* locale, _In_ void* help_ptr);
+	int loadAdvancedHelpIntoRegistry(_In_ void* registry_ptr, _In_ const char* name, _In_opt_ const char* locale, _In_ const char* help_filename);
+	int removeAdvancedHelpFromRegistry(_In_ void* registry_ptr, _In_ const char* name);
+
+	char* getAdvancedHelpForKeywordByName(_In_ const char* keyword, _In_ void* registry_ptr, _In_ const char* name);
+	char* getAdvancedHelpForKeywordByLocale(_In_ const char* keyword, _In_ void* registry_ptr, _In_ const char* locale);
+	int getAdvancedHelpForKeywordMulti(_In_ const char* keyword, _In_ void* registry_ptr, _In_reads_(count) const char* const* names, _In_ size_t count, _Out_writes_(count) char** results);
+
+	void getAdvancedHelpRegistryTextBytes(_In_ void* registry_ptr, _Out_opt_ size_t* unique_bytes, _Out_opt_ size_t* referenced_bytes);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADVANCED_HELP_REGISTRY_H
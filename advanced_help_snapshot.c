@@ -0,0 +1,353 @@
+
+/////   INCLUDES   /////
+
+#include "advanced_help_snapshot.h"
+#include "advanced_help_internal.h"
+
+#include <stdint.h>
+
+
+
+
+/////   DEFINES   /////
+
+#define SNAPSHOT_MAGIC "AHSNAP\r\n"		// The "\r\n" catches files mangled by text mode conversions
+#define SNAPSHOT_VERSION 1
+
+#define SNAPSHOT_FNV_OFFSET_BASIS 14695981039346656037ULL
+#define SNAPSHOT_FNV_PRIME 1099511628211ULL
+
+
+
+
+/////   TYPES   /////
+
+// Layout of the file: the header, the entries sorted by keyword (so they can be binary searched) and the strings they point to.
+// Offsets are from the start of the file. All the strings are null-terminated
+typedef struct AdvancedHelpSnapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t content_hash;	// See getAdvancedHelpContentHash()
+	uint64_t entry_count;
+	uint64_t file_size;
+} AdvancedHelpSnapshotHeader;
+
+typedef struct AdvancedHelpSnapshotEntry {
+	uint64_t keyword_offset;
+	uint64_t result_offset;		// Only for ADVANCED_HELP_STATUS_OK
+	uint64_t result_len;
+	uint64_t error_line;		// Only for ADVANCED_HELP_STATUS_FORMAT_ERROR
+	uint64_t error_level;
+	int64_t status;
+} AdvancedHelpSnapshotEntry;
+
+// A snapshot file mapped in memory and attached to a help
+typedef struct AdvancedHelpSnapshot {
+	HANDLE file;
+	HANDLE mapping;
+	const char* view;
+	const AdvancedHelpSnapshotEntry* entries;
+	size_t entry_count;
+} AdvancedHelpSnapshot;
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+uint64_t getAdvancedHelpContentHash(_In_ const AdvancedHelp* help);
+uint64_t hashSnapshotBytes(_In_ uint64_t hash, _In_reads_(len) const void* data, _In_ size_t len);
+bool isValidSnapshot(_In_ const char* view, _In_ size_t size);
+int compareSnapshotKeywords(_In_ const void* a, _In_ const void* b);
+
+
+
+
+/////   FUNCTION IMPLEMENTATIONS   /////
+
+// Runs the queries of the keywords on the help and writes their results to the snapshot file (replacing it if it exists). Empty and repeated keywords are skipped.
+// Returns 0 on success, -1 if the arguments are wrong, -2 if there is not enough memory, -3 if the file could not be written
+int saveAdvancedHelpSnapshot(_In_ void* help_ptr, _In_reads_(keyword_count) const char* const* keywords, _In_ size_t keyword_count, _In_ const char* snapshot_filename) {
+	const AdvancedHelp* help = (const AdvancedHelp*)help_ptr;
+	if (NULL == help || help->is_wide || (NULL == keywords && 0 != keyword_count) || NULL == snapshot_filename) {
+		return -1;
+	}
+
+	int error = 0;
+	const char** sorted_keywords = NULL;
+	AdvancedHelpSnapshotEntry* entries = NULL;
+	char** results = NULL;
+	size_t entry_count = 0;
+	FILE* fp = NULL;
+
+	if (0 != keyword_count) {
+		sorted_keywords = (const char**)malloc(sizeof(const char*) * keyword_count);
+		entries = (AdvancedHelpSnapshotEntry*)calloc(keyword_count, sizeof(AdvancedHelpSnapshotEntry));
+		results = (char**)calloc(keyword_count, sizeof(char*));
+		if (NULL == sorted_keywords || NULL == entries || NULL == results) {
+			error = -2;
+			goto SAVE_SNAPSHOT_END_LABEL;
+		}
+	}
+	// Entries must be sorted by keyword, without repeated ones
+	size_t sorted_count = 0;
+	for (size_t i = 0; i < keyword_count; i++) {
+		if (NULL == keywords[i]) {
+			error = -1;
+			goto SAVE_SNAPSHOT_END_LABEL;
+		}
+		if ('\0' != keywords[i][0]) {
+			sorted_keywords[sorted_count] = keywords[i];
+			sorted_count++;
+		}
+	}
+	if (0 != sorted_count) {
+		qsort(sorted_keywords, sorted_count, sizeof(const char*), compareSnapshotKeywords);
+	}
+	for (size_t i = 0; i < sorted_count; i++) {
+		if (0 == entry_count || 0 != strcmp(sorted_keywords[i], sorted_keywords[entry_count - 1])) {
+			sorted_keywords[entry_count] = sorted_keywords[i];
+			entry_count++;
+		}
+	}
+
+	// Run the queries and place their strings after the entries
+	uint64_t offset = sizeof(AdvancedHelpSnapshotHeader) + sizeof(AdvancedHelpSnapshotEntry) * entry_count;
+	for (size_t i = 0; i < entry_count; i++) {
+		AdvancedHelpSnapshotEntry* entry = &(entries[i]);
+		AdvancedHelpErrorInfo error_info;
+		size_t result_len = 0;
+		AdvancedHelpStatus status = getAdvancedHelpForKeywordEx(sorted_keywords[i], help_ptr, &(results[i]), &result_len, &error_info);
+		if (ADVANCED_HELP_STATUS_NOMEM_ERROR == status) {
+			error = -2;
+			goto SAVE_SNAPSHOT_END_LABEL;
+		}
+		entry->status = (int64_t)status;
+		entry->error_line = error_info.line;
+		entry->error_level = error_info.level;
+		entry->keyword_offset = offset;
+		offset += strlen(sorted_keywords[i]) + 1;
+		if (NULL != results[i]) {
+			entry->result_offset = offset;
+			entry->result_len = result_len;
+			offset += result_len + 1;
+		}
+	}
+
+	AdvancedHelpSnapshotHeader header = { 0 };
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.content_hash = getAdvancedHelpContentHash(help);
+	header.entry_count = entry_count;
+	header.file_size = offset;
+
+	fopen_s(&fp, snapshot_filename, "wb");
+	if (NULL == fp) {
+		error = -3;
+		goto SAVE_SNAPSHOT_END_LABEL;
+	}
+	bool written = (1 == fwrite(&header, sizeof(header), 1, fp)) && (0 == entry_count || entry_count == fwrite(entries, sizeof(AdvancedHelpSnapshotEntry), entry_count, fp));
+	for (size_t i = 0; i < entry_count && written; i++) {
+		written = (1 == fwrite(sorted_keywords[i], strlen(sorted_keywords[i]) + 1, 1, fp));
+		if (written && NULL != results[i]) {
+			written = (1 == fwrite(results[i], (size_t)entries[i].result_len + 1, 1, fp));
+		}
+	}
+	if (0 != fclose(fp) || !written) {
+		error = -3;
+	}
+
+SAVE_SNAPSHOT_END_LABEL:
+	if (NULL != results) {
+		for (size_t i = 0; i < keyword_count; i++) {
+			free(results[i]);
+		}
+	}
+	free(results);
+	free(entries);
+	free(sorted_keywords);
+	return error;
+}
+
+// Maps the snapshot file and attaches it to the help, replacing the previous one (if any).
+// Returns 0 on success, -1 if the arguments are wrong, -2 if there is not enough memory, -3 if the file could not be opened or mapped,
+// -4 if it is not a valid snapshot file, -5 if it is the snapshot of a different help
+int loadAdvancedHelpSnapshot(_In_ void* help_ptr, _In_ const char* snapshot_filename) {
+	AdvancedHelp* help = (AdvancedHelp*)help_ptr;
+	if (NULL == help || help->is_wide || NULL == snapshot_filename) {
+		return -1;
+	}
+
+	int error = 0;
+	HANDLE mapping = NULL;
+	const char* view = NULL;
+	HANDLE file = CreateFileA(snapshot_filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (INVALID_HANDLE_VALUE == file) {
+		return -3;
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		error = -3;
+		goto LOAD_SNAPSHOT_ERROR_LABEL;
+	}
+	if (file_size.QuadPart < (long long)sizeof(AdvancedHelpSnapshotHeader)) {
+		error = -4;	// Empty files can not even be mapped
+		goto LOAD_SNAPSHOT_ERROR_LABEL;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (NULL == mapping) {
+		error = -3;
+		goto LOAD_SNAPSHOT_ERROR_LABEL;
+	}
+	view = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (NULL == view) {
+		error = -3;
+		goto LOAD_SNAPSHOT_ERROR_LABEL;
+	}
+
+	// Everything is checked now, so the queries can trust the file
+	if (!isValidSnapshot(view, (size_t)file_size.QuadPart)) {
+		error = -4;
+		goto LOAD_SNAPSHOT_ERROR_LABEL;
+	}
+	const AdvancedHelpSnapshotHeader* header = (const AdvancedHelpSnapshotHeader*)view;
+	if (header->content_hash != getAdvancedHelpContentHash(help)) {
+		error = -5;
+		goto LOAD_SNAPSHOT_ERROR_LABEL;
+	}
+
+	AdvancedHelpSnapshot* snapshot = (AdvancedHelpSnapshot*)malloc(sizeof(AdvancedHelpSnapshot));
+	if (NULL == snapshot) {
+		error = -2;
+		goto LOAD_SNAPSHOT_ERROR_LABEL;
+	}
+	snapshot->file = file;
+	snapshot->mapping = mapping;
+	snapshot->view = view;
+	snapshot->entries = (const AdvancedHelpSnapshotEntry*)(view + sizeof(AdvancedHelpSnapshotHeader));
+	snapshot->entry_count = (size_t)header->entry_count;
+
+	freeAdvancedHelpSnapshot(help->snapshot);
+	help->snapshot = snapshot;
+	return 0;
+
+LOAD_SNAPSHOT_ERROR_LABEL:
+	if (NULL != view) {
+		UnmapViewOfFile(view);
+	}
+	if (NULL != mapping) {
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+	return error;
+}
+
+void unloadAdvancedHelpSnapshot(_In_ void* help_ptr) {
+	AdvancedHelp* help = (AdvancedHelp*)help_ptr;
+	if (NULL != help) {
+		freeAdvancedHelpSnapshot(help->snapshot);
+		help->snapshot = NULL;
+	}
+}
+
+// Looks for the keyword in the snapshot. If it is there, returns true and sets the status of the query (the result is appended to
+// the buffer if the status is ADVANCED_HELP_STATUS_OK, and error_info is set for ADVANCED_HELP_STATUS_FORMAT_ERROR)
+bool findAdvancedHelpSnapshotResult(_In_ const AdvancedHelpSnapshot* snapshot, _In_ const char* keyword, _Out_ AdvancedHelpStatus* status_ptr, _Inout_ AdvancedHelpBuffer* result, _Out_opt_ AdvancedHelpErrorInfo* error_info) {
+	size_t begin = 0;
+	size_t end = snapshot->entry_count;
+	while (begin < end) {
+		size_t middle = begin + (end - begin) / 2;
+		const AdvancedHelpSnapshotEntry* entry = &(snapshot->entries[middle]);
+		int comparison = strcmp(keyword, snapshot->view + entry->keyword_offset);
+		if (comparison < 0) {
+			end = middle;
+		} else if (comparison > 0) {
+			begin = middle + 1;
+		} else {
+			*status_ptr = (AdvancedHelpStatus)entry->status;
+			if (ADVANCED_HELP_STATUS_OK == *status_ptr && 0 != appendToAdvancedHelpBuffer(result, snapshot->view + entry->result_offset, (size_t)entry->result_len)) {
+				*status_ptr = ADVANCED_HELP_STATUS_NOMEM_ERROR;
+			}
+			if (ADVANCED_HELP_STATUS_FORMAT_ERROR == *status_ptr && NULL != error_info) {
+				error_info->line = (size_t)entry->error_line;
+				error_info->level = (size_t)entry->error_level;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void freeAdvancedHelpSnapshot(_In_opt_ AdvancedHelpSnapshot* snapshot) {
+	if (NULL != snapshot) {
+		UnmapViewOfFile(snapshot->view);
+		CloseHandle(snapshot->mapping);
+		CloseHandle(snapshot->file);
+		free(snapshot);
+	}
+}
+
+// FNV-1a hash of the format and the nodes of the help (not of its text, so it does not depend on how it was loaded).
+// The line of every node is hashed too, since the snapshot keeps the error lines
+uint64_t getAdvancedHelpContentHash(_In_ const AdvancedHelp* help) {
+	uint64_t hash = SNAPSHOT_FNV_OFFSET_BASIS;
+	uint64_t max_node_level = help->options.max_node_level;
+	hash = hashSnapshotBytes(hash, &max_node_level, sizeof(max_node_level));
+	hash = hashSnapshotBytes(hash, &(help->options.node_level_char), 1);
+	hash = hashSnapshotBytes(hash, &(help->options.node_start_char), 1);
+	for (size_t i = 0; i < help->node_count; i++) {
+		const AdvancedHelpNodeRef* node = &ADVANCED_HELP_NODE(help, i);
+		uint64_t level = node->level;
+		uint64_t len = node->len;
+		uint64_t line = node->line;
+		hash = hashSnapshotBytes(hash, &level, sizeof(level));
+		hash = hashSnapshotBytes(hash, &len, sizeof(len));
+		hash = hashSnapshotBytes(hash, &line, sizeof(line));
+		hash = hashSnapshotBytes(hash, node->text, node->len);
+	}
+	return hash;
+}
+
+uint64_t hashSnapshotBytes(_In_ uint64_t hash, _In_reads_(len) const void* data, _In_ size_t len) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= bytes[i];
+		hash *= SNAPSHOT_FNV_PRIME;
+	}
+	return hash;
+}
+
+// Checks the header, that every offset is inside the file, that every string is null-terminated and that the entries are sorted
+bool isValidSnapshot(_In_ const char* view, _In_ size_t size) {
+	const AdvancedHelpSnapshotHeader* header = (const AdvancedHelpSnapshotHeader*)view;
+	if (0 != memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) || SNAPSHOT_VERSION != header->version || size != header->file_size) {
+		return false;
+	}
+	if (header->entry_count > (size - sizeof(AdvancedHelpSnapshotHeader)) / sizeof(AdvancedHelpSnapshotEntry)) {
+		return false;
+	}
+
+	const AdvancedHelpSnapshotEntry* entries = (const AdvancedHelpSnapshotEntry*)(view + sizeof(AdvancedHelpSnapshotHeader));
+	for (size_t i = 0; i < header->entry_count; i++) {
+		const AdvancedHelpSnapshotEntry* entry = &(entries[i]);
+		if (entry->keyword_offset >= size || NULL == memchr(view + entry->keyword_offset, '\0', size - (size_t)entry->keyword_offset)) {
+			return false;
+		}
+		if (0 != i && strcmp(view + entries[i - 1].keyword_offset, view + entry->keyword_offset) >= 0) {
+			return false;
+		}
+		if (ADVANCED_HELP_STATUS_OK != entry->status && ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND != entry->status && ADVANCED_HELP_STATUS_FORMAT_ERROR != entry->status) {
+			return false;	// The only outcomes of the queries that are saved
+		}
+		if (ADVANCED_HELP_STATUS_OK == entry->status &&
+			(entry->result_offset >= size || entry->result_len >= size - entry->result_offset || '\0' != view[entry->result_offset + entry->result_len])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int compareSnapshotKeywords(_In_ const void* a, _In_ const void* b) {
+	return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
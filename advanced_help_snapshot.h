@@ -0,0 +1,33 @@
+#ifndef ADVANCED_HELP_SNAPSHOT_H
+#define ADVANCED_HELP_SNAPSHOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+	/////   INCLUDES   /////
+#include "advanced_help.h"
+
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+	// A snapshot file keeps the results of some keywords (e.g. the most popular ones) for one help, so that after a restart those queries
+	// are answered straight from the file instead of searching the help. The file is mapped in memory, not read, and it is stamped with
+	// a hash of the nodes (with their lines) and the format of the help: a snapshot of a different (or edited) help is rejected.
+	// Only getAdvancedHelpForKeyword(Ex) use the snapshot. WCHAR helps are not supported.
+	// Loading and unloading are not thread-safe: no query may run on the help at the same time. Editing the help unloads its snapshot.
+
+	int saveAdvancedHelpSnapshot(_In_ void* help_ptr, _In_reads_(keyword_count) const char* const* keywords, _In_ size_t keyword_count, _In_ const char* snapshot_filename);
+	int loadAdvancedHelpSnapshot(_In_ void* help_ptr, _In_ const char* snapshot_filename);
+	void unloadAdvancedHelpSnapshot(_In_ void* help_ptr);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADVANCED_HELP_SNAPSHOT_H
@@ -0,0 +1,310 @@
+
+/////   INCLUDES   /////
+
+#include "advanced_help_stats.h"
+#include "advanced_help_internal.h"
+
+
+
+
+/////   TYPES   /////
+
+// Counters of one thread. Only that thread writes them; readers add up all the blocks
+typedef struct AdvancedHelpThreadStats {
+	AdvancedHelpStats counters;
+	unsigned long long allocations;	// Always growing (not reset), used to get the allocations of each query
+	struct AdvancedHelpThreadStats* next;
+} AdvancedHelpThreadStats;
+
+// A callback and its context, swapped in together so that a query reads both with a single load
+typedef struct AdvancedHelpStatsCallbackPair {
+	AdvancedHelpStatsCallback callback;
+	void* callback_ctx;
+	struct AdvancedHelpStatsCallbackPair* next;
+} AdvancedHelpStatsCallbackPair;
+
+
+
+
+/////   GLOBAL VARS   /////
+
+volatile bool advanced_help_stats_enabled = false;
+
+// When a thread exits, its block is added to retired_stats and freed (through the FLS callback), so the list only holds the live threads
+AdvancedHelpThreadStats* all_thread_stats = NULL;
+AdvancedHelpStats retired_stats = { 0 };
+SRWLOCK all_thread_stats_lock = SRWLOCK_INIT;
+DWORD thread_stats_fls_index = FLS_OUT_OF_INDEXES;
+bool thread_stats_fls_allocated = false;
+__declspec(thread) AdvancedHelpThreadStats* current_thread_stats = NULL;
+
+// Pairs are never freed (a query may still be reading the one it loaded), but a pair that was already set is reused,
+// so the list only grows with the number of different callbacks and contexts
+AdvancedHelpStatsCallbackPair* volatile stats_callback = NULL;
+AdvancedHelpStatsCallbackPair* all_stats_callbacks = NULL;
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+AdvancedHelpThreadStats* getCurrentThreadStats();
+VOID NTAPI retireThreadStats(_In_opt_ PVOID data);
+void addAdvancedHelpStats(_Inout_ AdvancedHelpStats* stats, _In_ const AdvancedHelpStats* counters);
+unsigned long long getElapsedMicroseconds(_In_ const LARGE_INTEGER* start);
+
+
+
+
+/////   FUNCTION IMPLEMENTATIONS   /////
+
+void enableAdvancedHelpStats(_In_ bool enable) {
+	advanced_help_stats_enabled = enable;
+}
+
+// Snapshot of the counters of all threads. Counters being updated at the same time by other threads may be off by the last query
+void getAdvancedHelpStats(_Out_ AdvancedHelpStats* stats) {
+	memset(stats, 0, sizeof(AdvancedHelpStats));
+
+	AcquireSRWLockShared(&all_thread_stats_lock);
+	addAdvancedHelpStats(stats, &retired_stats);
+	for (AdvancedHelpThreadStats* thread_stats = all_thread_stats; NULL != thread_stats; thread_stats = thread_stats->next) {
+		addAdvancedHelpStats(stats, &(thread_stats->counters));
+	}
+	ReleaseSRWLockShared(&all_thread_stats_lock);
+}
+
+// Queries running at the same time may keep some of their counts
+void resetAdvancedHelpStats() {
+	AcquireSRWLockExclusive(&all_thread_stats_lock);
+	memset(&retired_stats, 0, sizeof(AdvancedHelpStats));
+	for (AdvancedHelpThreadStats* thread_stats = all_thread_stats; NULL != thread_stats; thread_stats = thread_stats->next) {
+		memset(&(thread_stats->counters), 0, sizeof(AdvancedHelpStats));
+	}
+	ReleaseSRWLockExclusive(&all_thread_stats_lock);
+}
+
+// Returns 0, or -2 if there is not enough memory (the previous callback is kept then)
+int setAdvancedHelpStatsCallback(_In_opt_ AdvancedHelpStatsCallback callback, _Inout_opt_ void* callback_ctx) {
+	AdvancedHelpStatsCallbackPair* pair = NULL;
+	if (NULL != callback) {
+		AcquireSRWLockExclusive(&all_thread_stats_lock);
+		pair = all_stats_callbacks;
+		while (NULL != pair && (pair->callback != callback || pair->callback_ctx != callback_ctx)) {
+			pair = pair->next;
+		}
+		if (NULL == pair) {
+			pair = (AdvancedHelpStatsCallbackPair*)calloc(1, sizeof(AdvancedHelpStatsCallbackPair));
+			if (NULL != pair) {
+				pair->callback = callback;
+				pair->callback_ctx = callback_ctx;
+				pair->next = all_stats_callbacks;
+				all_stats_callbacks = pair;
+			}
+		}
+		ReleaseSRWLockExclusive(&all_thread_stats_lock);
+		if (NULL == pair) {
+			return -2;
+		}
+	}
+	InterlockedExchangePointer((PVOID volatile*)&stats_callback, pair);
+	return 0;
+}
+
+void beginAdvancedHelpQueryStats(_Out_ AdvancedHelpStatsRecord* record) {
+	record->thread_stats = NULL;
+	if (!advanced_help_stats_enabled) {
+		return;
+	}
+	record->thread_stats = getCurrentThreadStats();
+	if (NULL == record->thread_stats) {
+		return;
+	}
+	record->allocations_at_start = record->thread_stats->allocations;
+	QueryPerformanceCounter(&(record->start));
+}
+
+void endAdvancedHelpQueryStats(_In_ const AdvancedHelpStatsRecord* record, _In_ AdvancedHelpStatus status, _In_ size_t nodes_scanned, _In_ size_t nodes_matched, _In_ size_t bytes_emitted) {
+	AdvancedHelpThreadStats* thread_stats = record->thread_stats;
+	if (NULL == thread_stats) {
+		return;
+	}
+
+	AdvancedHelpQueryStats query_stats;
+	query_stats.status = status;
+	query_stats.latency_us = getElapsedMicroseconds(&(record->start));
+	query_stats.nodes_scanned = nodes_scanned;
+	query_stats.nodes_matched = nodes_matched;
+	query_stats.bytes_emitted = bytes_emitted;
+	query_stats.allocations = thread_stats->allocations - record->allocations_at_start;
+
+	AdvancedHelpStats* counters = &(thread_stats->counters);
+	counters->queries++;
+	counters->query_time_us += query_stats.latency_us;
+	size_t bucket = 0;
+	while (bucket < ADVANCED_HELP_STATS_LATENCY_BUCKETS - 1 && query_stats.latency_us >= (1ULL << bucket)) {
+		bucket++;
+	}
+	counters->latency_histogram[bucket]++;
+	counters->nodes_scanned += query_stats.nodes_scanned;
+	counters->nodes_matched += query_stats.nodes_matched;
+	counters->bytes_emitted += query_stats.bytes_emitted;
+	counters->allocations += query_stats.allocations;
+	switch (status) {
+	case ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND:
+		counters->keyword_not_found++;
+		break;
+	case ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR:
+		counters->uninitialized_errors++;
+		break;
+	case ADVANCED_HELP_STATUS_FORMAT_ERROR:
+		counters->format_errors++;
+		break;
+	case ADVANCED_HELP_STATUS_NOMEM_ERROR:
+		counters->nomem_errors++;
+		break;
+	case ADVANCED_HELP_STATUS_SINK_ERROR:
+		counters->sink_errors++;
+		break;
+	case ADVANCED_HELP_STATUS_CANCELLED:
+		counters->cancelled++;
+		break;
+	default:
+		break;
+	}
+
+	// A single acquire load gets the callback and its context (the callback may get the stats or change the callback)
+	const AdvancedHelpStatsCallbackPair* pair = (const AdvancedHelpStatsCallbackPair*)ReadPointerAcquire((PVOID const volatile*)&stats_callback);
+	if (NULL != pair) {
+		pair->callback(pair->callback_ctx, &query_stats);
+	}
+}
+
+void beginAdvancedHelpLoadStats(_Out_ AdvancedHelpStatsRecord* record) {
+	beginAdvancedHelpQueryStats(record);
+}
+
+void endAdvancedHelpLoadStats(_In_ const AdvancedHelpStatsRecord* record, _In_ bool success, _In_ size_t bytes_loaded, _In_ size_t nodes_loaded, _In_ size_t max_depth) {
+	AdvancedHelpThreadStats* thread_stats = record->thread_stats;
+	if (NULL == thread_stats) {
+		return;
+	}
+
+	AdvancedHelpStats* counters = &(thread_stats->counters);
+	counters->loads++;
+	if (!success) {
+		counters->load_errors++;
+	}
+	counters->load_time_us += getElapsedMicroseconds(&(record->start));
+	counters->bytes_loaded += bytes_loaded;
+	counters->nodes_loaded += nodes_loaded;
+	if (max_depth > counters->max_depth) {
+		counters->max_depth = max_depth;
+	}
+}
+
+void countAdvancedHelpAllocation() {
+	if (!advanced_help_stats_enabled) {
+		return;
+	}
+	AdvancedHelpThreadStats* thread_stats = getCurrentThreadStats();
+	if (NULL != thread_stats) {
+		thread_stats->allocations++;
+	}
+}
+
+void countAdvancedHelpCacheHit() {
+	if (!advanced_help_stats_enabled) {
+		return;
+	}
+	AdvancedHelpThreadStats* thread_stats = getCurrentThreadStats();
+	if (NULL != thread_stats) {
+		thread_stats->counters.cache_hits++;
+	}
+}
+
+// Gets the counters of the calling thread, creating them the first time. Returns NULL if there is not enough memory
+AdvancedHelpThreadStats* getCurrentThreadStats() {
+	if (NULL != current_thread_stats) {
+		return current_thread_stats;
+	}
+
+	AdvancedHelpThreadStats* thread_stats = (AdvancedHelpThreadStats*)calloc(1, sizeof(AdvancedHelpThreadStats));
+	if (NULL == thread_stats) {
+		return NULL;
+	}
+	AcquireSRWLockExclusive(&all_thread_stats_lock);
+	if (!thread_stats_fls_allocated) {
+		thread_stats_fls_index = FlsAlloc(retireThreadStats);
+		thread_stats_fls_allocated = true;
+	}
+	DWORD fls_index = thread_stats_fls_index;
+	thread_stats->next = all_thread_stats;
+	all_thread_stats = thread_stats;
+	ReleaseSRWLockExclusive(&all_thread_stats_lock);
+
+	// Without an FLS slot the block is just never retired
+	if (FLS_OUT_OF_INDEXES != fls_index) {
+		FlsSetValue(fls_index, thread_stats);
+	}
+	current_thread_stats = thread_stats;
+	return thread_stats;
+}
+
+// FLS callback, run when the thread exits. The counters are kept in retired_stats and the block is freed.
+// Only the thread that owns the block retires it (a fiber deleted from another thread leaves it in the list)
+VOID NTAPI retireThreadStats(_In_opt_ PVOID data) {
+	AdvancedHelpThreadStats* thread_stats = (AdvancedHelpThreadStats*)data;
+	if (NULL == thread_stats || thread_stats != current_thread_stats) {
+		return;
+	}
+
+	AcquireSRWLockExclusive(&all_thread_stats_lock);
+	addAdvancedHelpStats(&retired_stats, &(thread_stats->counters));
+	AdvancedHelpThreadStats** link = &all_thread_stats;
+	while (*link != thread_stats) {
+		link = &((*link)->next);
+	}
+	*link = thread_stats->next;
+	ReleaseSRWLockExclusive(&all_thread_stats_lock);
+
+	current_thread_stats = NULL;
+	free(thread_stats);
+}
+
+void addAdvancedHelpStats(_Inout_ AdvancedHelpStats* stats, _In_ const AdvancedHelpStats* counters) {
+	stats->loads += counters->loads;
+	stats->load_errors += counters->load_errors;
+	stats->load_time_us += counters->load_time_us;
+	stats->bytes_loaded += counters->bytes_loaded;
+	stats->nodes_loaded += counters->nodes_loaded;
+	if (counters->max_depth > stats->max_depth) {
+		stats->max_depth = counters->max_depth;
+	}
+
+	stats->queries += counters->queries;
+	stats->query_time_us += counters->query_time_us;
+	for (size_t i = 0; i < ADVANCED_HELP_STATS_LATENCY_BUCKETS; i++) {
+		stats->latency_histogram[i] += counters->latency_histogram[i];
+	}
+	stats->nodes_scanned += counters->nodes_scanned;
+	stats->nodes_matched += counters->nodes_matched;
+	stats->bytes_emitted += counters->bytes_emitted;
+	stats->allocations += counters->allocations;
+	stats->cache_hits += counters->cache_hits;
+
+	stats->keyword_not_found += counters->keyword_not_found;
+	stats->uninitialized_errors += counters->uninitialized_errors;
+	stats->format_errors += counters->format_errors;
+	stats->nomem_errors += counters->nomem_errors;
+	stats->sink_errors += counters->sink_errors;
+	stats->cancelled += counters->cancelled;
+}
+
+unsigned long long getElapsedMicroseconds(_In_ const LARGE_INTEGER* start) {
+	LARGE_INTEGER now;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+	return (unsigned long long)((now.QuadPart - start->QuadPart) * 1000000LL / frequency.QuadPart);
+}
@@ -0,0 +1,85 @@
+#ifndef ADVANCED_HELP_STATS_H
+#define ADVANCED_HELP_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+	/////   INCLUDES   /////
+#include "advanced_help.h"
+
+
+
+
+
+/////   DEFINES   /////
+
+// Bucket i of the latency histogram counts the queries that took less than 2^i microseconds (and not less than 2^(i-1)).
+// The last bucket counts all the slower ones
+#define ADVANCED_HELP_STATS_LATENCY_BUCKETS 24
+
+
+
+/////   TYPES   /////
+
+	// Totals since the stats were enabled (or reset)
+	typedef struct AdvancedHelpStats {
+		// initAdvancedHelp / initAdvancedHelpW
+		unsigned long long loads;
+		unsigned long long load_errors;
+		unsigned long long load_time_us;
+		unsigned long long bytes_loaded;
+		unsigned long long nodes_loaded;
+		unsigned long long max_depth;			// Deepest node level loaded (maximum, not total)
+
+		// Queries (every call to advancedHelpQueryNext counts as one query)
+		unsigned long long queries;
+		unsigned long long query_time_us;
+		unsigned long long latency_histogram[ADVANCED_HELP_STATS_LATENCY_BUCKETS];
+		unsigned long long nodes_scanned;
+		unsigned long long nodes_matched;		// Nodes containing the keyword (parents and subnodes shown because of them are not counted)
+		unsigned long long bytes_emitted;
+		unsigned long long allocations;
+		unsigned long long cache_hits;			// Queries answered from a snapshot file (see advanced_help_snapshot.h)
+
+		// Queries by status (other than ADVANCED_HELP_STATUS_OK)
+		unsigned long long keyword_not_found;
+		unsigned long long uninitialized_errors;
+		unsigned long long format_errors;
+		unsigned long long nomem_errors;
+		unsigned long long sink_errors;
+		unsigned long long cancelled;			// Asynchronous queries stopped by cancelAdvancedHelpAsync()
+	} AdvancedHelpStats;
+
+	// Passed to the stats callback after every query
+	typedef struct AdvancedHelpQueryStats {
+		AdvancedHelpStatus status;
+		unsigned long long latency_us;
+		unsigned long long nodes_scanned;
+		unsigned long long nodes_matched;
+		unsigned long long bytes_emitted;
+		unsigned long long allocations;
+	} AdvancedHelpQueryStats;
+
+	typedef void (*AdvancedHelpStatsCallback)(_Inout_opt_ void* callback_ctx, _In_ const AdvancedHelpQueryStats* query_stats);
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+	// Stats are disabled by default. Counters are kept per thread (no locks nor atomics in the queries) and added up when read (with the counters of the threads that already exited)
+	void enableAdvancedHelpStats(_In_ bool enable);
+	void getAdvancedHelpStats(_Out_ AdvancedHelpStats* stats);
+	void resetAdvancedHelpStats();
+
+	// The callback is run in the thread that made the query, so it must be thread-safe if queries are made from several threads.
+	// Changing it takes no lock in the queries, but a query that already started may still call the previous one
+	int setAdvancedHelpStatsCallback(_In_opt_ AdvancedHelpStatsCallback callback, _Inout_opt_ void* callback_ctx);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADVANCED_HELP_STATS_H
@@ -0,0 +1,465 @@
+
+// Fuzz harness for the help parser and the query engine, with a differential oracle: every query path of the library (node table,
+// specialized node kernels, Ex, WCHAR, cursor, streaming formatter, registry, snapshots, edited helps and async queries) must give the same result as the
+// frozen reference implementation (see advanced_help_reference.h). Any difference aborts, so the fuzzer reports it as a crash.
+//
+// Input: 1 byte of flags, 1 byte with the keyword length, the keyword and the help text (both cut at the first '\0').
+//
+// Build on Linux (fuzz/compat stands in for the Windows headers), from the root of the repository:
+//    libFuzzer:  clang -g -O1 -fsanitize=fuzzer,address,undefined -DADVANCED_HELP_FUZZ_LIBFUZZER -Ifuzz/compat -I. fuzz/*.c advanced_help*.c -lpthread -o advanced_help_fuzz
+//                ./advanced_help_fuzz fuzz/corpus
+//    AFL:        afl-clang-fast -g -fsanitize=address,undefined -Ifuzz/compat -I. fuzz/*.c advanced_help*.c -lpthread -o advanced_help_fuzz
+//                afl-fuzz -i fuzz/corpus -o findings_dir -- ./advanced_help_fuzz @@
+// Without ADVANCED_HELP_FUZZ_LIBFUZZER, the harness also replays inputs given as files (or read from stdin) with any compiler,
+// e.g. gcc -g -fsanitize=address,undefined -fno-sanitize-recover=undefined
+
+
+/////   INCLUDES   /////
+
+#include "advanced_help.h"
+#include "advanced_help_async.h"
+#include "advanced_help_edit.h"
+#include "advanced_help_format.h"
+#include "advanced_help_internal.h"
+#include "advanced_help_query.h"
+#include "advanced_help_registry.h"
+#include "advanced_help_reference.h"
+#include "advanced_help_snapshot.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+
+
+/////   DEFINES   /////
+
+#define FUZZ_MAX_KEYWORD_LEN 32
+
+// Flags (first byte of the input)
+#define FUZZ_FLAG_LEVEL_CHAR_SPACE 0x01		// Options with ' ' as node level char
+#define FUZZ_FLAG_START_CHAR_HASH 0x02		// Options with '#' as node start char
+#define FUZZ_FLAG_SMALL_PAGES 0x04			// Cursor pages of 1 node
+#define FUZZ_MAX_NODE_LEVEL_SHIFT 3			// The other bits select max_node_level (1 to 31)...
+#define FUZZ_MAX_NODE_LEVEL_UNLIMITED 31	// ...or no limit, with all of them set
+
+#define FUZZ_SNAPSHOT_FILENAME_SIZE 4096
+
+// Result taken by the callback of an async query
+typedef struct FuzzAsyncResult {
+	AdvancedHelpStatus status;
+	char* result;
+} FuzzAsyncResult;
+
+#define FUZZ_CHECK(condition, description) \
+	do { \
+		if (!(condition)) { \
+			fprintf(stderr, "advanced_help_fuzz: %s (keyword \"%s\")\n", description, keyword); \
+			abort(); \
+		} \
+	} while (0)
+
+
+
+
+/////   GLOBAL VARS   /////
+
+// Temp file of this process for the snapshots (so parallel workers never share one), written and mapped again for every input
+char fuzz_snapshot_filename[FUZZ_SNAPSHOT_FILENAME_SIZE] = "";
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+void checkAdvancedHelp(_In_ const char* keyword, _In_ const char* help_text, _In_opt_ const AdvancedHelpOptions* options, _In_ uint8_t flags);
+void checkCursor(_In_ const char* keyword, _In_ void* help_ptr, _In_ AdvancedHelpStatus expected_status, _In_ const char* expected, _In_ uint8_t flags);
+void checkFormatter(_In_ const char* keyword, _In_ void* help_ptr, _In_ const char* help_text, _In_ AdvancedHelpStatus expected_status, _In_ const char* expected);
+void checkRegistry(_In_ const char* keyword, _In_ void* help_ptr, _In_ const char* expected);
+void checkAsync(_In_ const char* keyword, _In_ void* help_ptr, _In_ AdvancedHelpStatus expected_status, _In_ const char* expected);
+void takeFuzzAsyncResult(_Inout_opt_ void* callback_ctx, _In_ void* async_ptr);
+void checkSnapshot(_In_ const char* keyword, _In_ void* help_ptr, _In_ const char* help_text, _In_opt_ const AdvancedHelpOptions* options, _In_ const char* expected);
+void checkEdit(_In_ const char* keyword, _In_ void* help_ptr, _In_ const char* expected);
+void checkWide(_In_ const char* keyword, _In_ const char* help_text, _In_opt_ const AdvancedHelpOptions* options, _In_ const char* expected);
+WCHAR* widenFuzzText(_In_ const char* text);
+char* copyFuzzText(_In_reads_(size) const uint8_t* data, _In_ size_t size);
+const char* getFuzzSnapshotFilename();
+void removeFuzzSnapshotFile();
+
+
+
+
+/////   FUNCTION IMPLEMENTATIONS   /////
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	if (size < 2) {
+		return 0;
+	}
+	uint8_t flags = data[0];
+	size_t keyword_len = data[1] % (FUZZ_MAX_KEYWORD_LEN + 1);
+	if (size - 2 < keyword_len) {
+		keyword_len = size - 2;
+	}
+	char* keyword = copyFuzzText(data + 2, keyword_len);
+	char* help_text = copyFuzzText(data + 2 + keyword_len, size - 2 - keyword_len);
+	if (NULL == keyword || NULL == help_text) {
+		free(keyword);
+		free(help_text);
+		return 0;
+	}
+
+	// Default format (constant node kernel), then the format chosen by the flags (runtime node kernel unless it is the default one)
+	AdvancedHelpOptions options = ADVANCED_HELP_DEFAULT_OPTIONS;
+	checkAdvancedHelp(keyword, help_text, NULL, flags);
+	size_t max_node_level_bits = (size_t)flags >> FUZZ_MAX_NODE_LEVEL_SHIFT;
+	options.max_node_level = (FUZZ_MAX_NODE_LEVEL_UNLIMITED == max_node_level_bits) ? 0 : 1 + max_node_level_bits;
+	if (0 != (flags & FUZZ_FLAG_LEVEL_CHAR_SPACE)) {
+		options.node_level_char = ' ';
+	}
+	if (0 != (flags & FUZZ_FLAG_START_CHAR_HASH)) {
+		options.node_start_char = '#';
+	}
+	checkAdvancedHelp(keyword, help_text, &options, flags);
+
+	free(keyword);
+	free(help_text);
+	return 0;
+}
+
+void checkAdvancedHelp(_In_ const char* keyword, _In_ const char* help_text, _In_opt_ const AdvancedHelpOptions* options, _In_ uint8_t flags) {
+	const AdvancedHelpOptions default_options = ADVANCED_HELP_DEFAULT_OPTIONS;
+	char* expected = getReferenceHelpForKeyword(keyword, help_text, (NULL != options) ? options : &default_options);
+	void* help_ptr = NULL;
+	if (NULL == expected || 0 != initAdvancedHelpFromText(help_text, options, &help_ptr)) {
+		free(expected);
+		return;	// Out of memory
+	}
+
+	char* result = getAdvancedHelpForKeyword(keyword, help_ptr);
+	FUZZ_CHECK(NULL != result && 0 == strcmp(expected, result), "getAdvancedHelpForKeyword() differs from the reference");
+	free(result);
+
+	// The status must explain the result
+	size_t result_len = 0;
+	AdvancedHelpStatus status = getAdvancedHelpForKeywordEx(keyword, help_ptr, &result, &result_len, NULL);
+	if (ADVANCED_HELP_STATUS_OK == status) {
+		FUZZ_CHECK(NULL != result && 0 == strcmp(expected, result) && strlen(result) == result_len, "getAdvancedHelpForKeywordEx() differs from the reference");
+	} else {
+		FUZZ_CHECK(NULL == result && 0 == strcmp(expected, getAdvancedHelpStatusMessage(status)), "getAdvancedHelpForKeywordEx() status differs from the reference");
+	}
+	free(result);
+
+	// An empty keyword returns the help text as it is, which only the plain formatter does too
+	checkFormatter(keyword, help_ptr, help_text, status, expected);
+	if ('\0' != keyword[0]) {
+		checkCursor(keyword, help_ptr, status, expected, flags);
+		checkRegistry(keyword, help_ptr, expected);
+	}
+	checkAsync(keyword, help_ptr, status, expected);
+	checkSnapshot(keyword, help_ptr, help_text, options, expected);
+	checkEdit(keyword, help_ptr, expected);
+	checkWide(keyword, help_text, options, expected);
+
+	freeAdvancedHelp(&help_ptr);
+	free(expected);
+}
+
+void checkCursor(_In_ const char* keyword, _In_ void* help_ptr, _In_ AdvancedHelpStatus expected_status, _In_ const char* expected, _In_ uint8_t flags) {
+	void* query_ptr = NULL;
+	if (0 != advancedHelpQueryOpen(keyword, help_ptr, &query_ptr)) {
+		return;
+	}
+
+	AdvancedHelpBuffer pages = { 0 };
+	AdvancedHelpStatus status = ADVANCED_HELP_STATUS_OK;
+	char* page = NULL;
+	size_t max_nodes = (0 != (flags & FUZZ_FLAG_SMALL_PAGES)) ? 1 : 3;
+	while (ADVANCED_HELP_STATUS_OK == (status = advancedHelpQueryNext(query_ptr, max_nodes, 0, &page)) && NULL != page) {
+		int error = appendToAdvancedHelpBuffer(&pages, page, strlen(page));
+		free(page);
+		if (0 != error) {
+			status = ADVANCED_HELP_STATUS_NOMEM_ERROR;
+			break;
+		}
+	}
+	advancedHelpQueryClose(&query_ptr);
+
+	if (ADVANCED_HELP_STATUS_NOMEM_ERROR != status) {
+		FUZZ_CHECK(ADVANCED_HELP_STATUS_KEYWORD_NOT_FOUND != status || NULL == pages.data, "advancedHelpQueryNext() returned a miss after some page");
+		FUZZ_CHECK(status == expected_status, "advancedHelpQueryNext() status differs from getAdvancedHelpForKeywordEx()");
+		FUZZ_CHECK(ADVANCED_HELP_STATUS_OK != status || 0 == strcmp(expected, pages.data), "advancedHelpQueryNext() pages differ from the reference");
+	}
+	free(pages.data);
+}
+
+void checkFormatter(_In_ const char* keyword, _In_ void* help_ptr, _In_ const char* help_text, _In_ AdvancedHelpStatus expected_status, _In_ const char* expected) {
+	// Errors are found after some nodes were already written, so there must be room for all the nodes (never longer than the text + 1)
+	AdvancedHelpBufferSink buffer_sink;
+	buffer_sink.size = strlen(help_text) + strlen(expected) + 2;
+	buffer_sink.buffer = (char*)malloc(buffer_sink.size);
+	buffer_sink.len = 0;
+	if (NULL == buffer_sink.buffer) {
+		return;
+	}
+
+	AdvancedHelpStatus status = writeAdvancedHelpForKeyword(keyword, help_ptr, ADVANCED_HELP_OUTPUT_PLAIN, getAdvancedHelpBufferSink(&buffer_sink));
+	FUZZ_CHECK(status == expected_status, "writeAdvancedHelpForKeyword() status differs from getAdvancedHelpForKeywordEx()");
+	FUZZ_CHECK(ADVANCED_HELP_STATUS_OK != status || 0 == strcmp(expected, buffer_sink.buffer), "writeAdvancedHelpForKeyword() differs from the reference");
+	free(buffer_sink.buffer);
+}
+
+void checkRegistry(_In_ const char* keyword, _In_ void* help_ptr, _In_ const char* expected) {
+	void* registry_ptr = NULL;
+	if (0 != initAdvancedHelpRegistry(&registry_ptr)) {
+		return;
+	}
+	if (0 == addAdvancedHelpToRegistry(registry_ptr, "fuzz", NULL, help_ptr)) {
+		char* result = getAdvancedHelpForKeywordByName(keyword, registry_ptr, "fuzz");
+		FUZZ_CHECK(NULL == result || 0 == strcmp(expected, result) || 0 == strcmp(ADVANCED_HELP_NOMEM_ERROR, result), "getAdvancedHelpForKeywordByName() differs from the reference");
+		free(result);
+	}
+	freeAdvancedHelpRegistry(&registry_ptr);
+}
+
+// The query is run in the thread pool three times: waited for, cancelled right after the submit (it may finish before noticing it),
+// and with its result taken by the callback, which must leave nothing for the getter
+void checkAsync(_In_ const char* keyword, _In_ void* help_ptr, _In_ AdvancedHelpStatus expected_status, _In_ const char* expected) {
+	void* async_ptr = NULL;
+	char* result = NULL;
+	size_t result_len = 0;
+	if (0 != getAdvancedHelpForKeywordAsync(keyword, help_ptr, NULL, NULL, NULL, &async_ptr)) {
+		return;	// Out of memory
+	}
+	AdvancedHelpStatus status = getAdvancedHelpAsyncQueryResult(async_ptr, &result, &result_len, NULL);
+	FUZZ_CHECK(isAdvancedHelpAsyncDone(async_ptr), "async query is not done after getting its result");
+	if (ADVANCED_HELP_STATUS_NOMEM_ERROR != status) {
+		FUZZ_CHECK(status == expected_status, "async query status differs from getAdvancedHelpForKeywordEx()");
+		FUZZ_CHECK(ADVANCED_HELP_STATUS_OK != status || (NULL != result && 0 == strcmp(expected, result) && strlen(result) == result_len), "async query result differs from the reference");
+	}
+	free(result);
+	status = getAdvancedHelpAsyncQueryResult(async_ptr, &result, NULL, NULL);
+	FUZZ_CHECK(ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR == status && NULL == result, "async query result was got twice");
+	freeAdvancedHelpAsync(&async_ptr);
+
+	if (0 != getAdvancedHelpForKeywordAsync(keyword, help_ptr, NULL, NULL, NULL, &async_ptr)) {
+		return;
+	}
+	cancelAdvancedHelpAsync(async_ptr);
+	status = getAdvancedHelpAsyncQueryResult(async_ptr, &result, NULL, NULL);
+	FUZZ_CHECK(ADVANCED_HELP_STATUS_CANCELLED == status || ADVANCED_HELP_STATUS_NOMEM_ERROR == status || status == expected_status, "cancelled async query status differs from getAdvancedHelpForKeywordEx()");
+	FUZZ_CHECK(ADVANCED_HELP_STATUS_OK != status || (NULL != result && 0 == strcmp(expected, result)), "cancelled async query result differs from the reference");
+	FUZZ_CHECK(ADVANCED_HELP_STATUS_OK == status || NULL == result, "cancelled async query returned a result with an error");
+	free(result);
+	freeAdvancedHelpAsync(&async_ptr);
+
+	FuzzAsyncResult callback_result = { ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR, NULL };
+	if (0 != getAdvancedHelpForKeywordAsync(keyword, help_ptr, takeFuzzAsyncResult, &callback_result, NULL, &async_ptr)) {
+		return;
+	}
+	status = getAdvancedHelpAsyncQueryResult(async_ptr, &result, NULL, NULL);
+	FUZZ_CHECK(ADVANCED_HELP_STATUS_UNINITIALIZED_ERROR == status && NULL == result, "async query result taken by the callback was got again");
+	if (ADVANCED_HELP_STATUS_NOMEM_ERROR != callback_result.status) {
+		FUZZ_CHECK(callback_result.status == expected_status, "async query status got by the callback differs from getAdvancedHelpForKeywordEx()");
+		FUZZ_CHECK(ADVANCED_HELP_STATUS_OK != callback_result.status || (NULL != callback_result.result && 0 == strcmp(expected, callback_result.result)), "async query result got by the callback differs from the reference");
+	}
+	free(callback_result.result);
+	freeAdvancedHelpAsync(&async_ptr);
+}
+
+void takeFuzzAsyncResult(_Inout_opt_ void* callback_ctx, _In_ void* async_ptr) {
+	FuzzAsyncResult* callback_result = (FuzzAsyncResult*)callback_ctx;
+	callback_result->status = getAdvancedHelpAsyncQueryResult(async_ptr, &(callback_result->result), NULL, NULL);
+}
+
+// The keyword is saved to a snapshot and answered from it by a second help loaded from the same text: the result, the status and the
+// error location must be the ones of the reference and of the query without snapshot
+void checkSnapshot(_In_ const char* keyword, _In_ void* help_ptr, _In_ const char* help_text, _In_opt_ const AdvancedHelpOptions* options, _In_ const char* expected) {
+	char* result = NULL;
+	size_t result_len = 0;
+	AdvancedHelpErrorInfo error_info;
+	AdvancedHelpStatus status = getAdvancedHelpForKeywordEx(keyword, help_ptr, &result, &result_len, &error_info);
+	const char* snapshot_filename = getFuzzSnapshotFilename();
+	void* snapshot_help_ptr = NULL;
+	if (ADVANCED_HELP_STATUS_NOMEM_ERROR == status || NULL == snapshot_filename || 0 != saveAdvancedHelpSnapshot(help_ptr, &keyword, 1, snapshot_filename) ||
+		0 != initAdvancedHelpFromText(help_text, options, &snapshot_help_ptr)) {
+		free(result);
+		return;	// Out of memory, or the file could not be written
+	}
+	int error = loadAdvancedHelpSnapshot(snapshot_help_ptr, snapshot_filename);
+	FUZZ_CHECK(0 == error || -2 == error || -3 == error, "loadAdvancedHelpSnapshot() rejected the snapshot of the same help");
+
+	char* snapshot_result = NULL;
+	size_t snapshot_result_len = 0;
+	AdvancedHelpErrorInfo snapshot_error_info;
+	AdvancedHelpStatus snapshot_status = getAdvancedHelpForKeywordEx(keyword, snapshot_help_ptr, &snapshot_result, &snapshot_result_len, &snapshot_error_info);
+	if (ADVANCED_HELP_STATUS_NOMEM_ERROR != snapshot_status) {
+		FUZZ_CHECK(snapshot_status == status, "snapshot status differs from getAdvancedHelpForKeywordEx()");
+		FUZZ_CHECK(snapshot_error_info.line == error_info.line && snapshot_error_info.level == error_info.level, "snapshot error location differs from getAdvancedHelpForKeywordEx()");
+		if (ADVANCED_HELP_STATUS_OK == snapshot_status) {
+			FUZZ_CHECK(NULL != snapshot_result && 0 == strcmp(expected, snapshot_result) && snapshot_result_len == result_len, "snapshot result differs from the reference");
+		} else {
+			FUZZ_CHECK(NULL == snapshot_result && 0 == strcmp(expected, getAdvancedHelpStatusMessage(snapshot_status)), "snapshot status differs from the reference");
+		}
+	}
+	free(snapshot_result);
+	free(result);
+	freeAdvancedHelp(&snapshot_help_ptr);
+}
+
+// Copies the first level 0 subtree in front of itself and deletes the original one. The result must not change,
+// but the nodes now go through the gap of the node table and the text chunks of the edits
+void checkEdit(_In_ const char* keyword, _In_ void* help_ptr, _In_ const char* expected) {
+	const AdvancedHelp* help = (const AdvancedHelp*)help_ptr;
+	if (0 == help->node_count || 0 != ADVANCED_HELP_NODE(help, 0).level) {
+		return;
+	}
+	if ('\0' != help->options.node_start_char && help->options.node_start_char == ADVANCED_HELP_NODE(help, 0).text[0]) {
+		return;	// The first node of a help keeps its node start char, an inserted one would not
+	}
+
+	AdvancedHelpBuffer subtree = { 0 };
+	size_t i = 0;
+	do {
+		const AdvancedHelpNodeRef* node = &ADVANCED_HELP_NODE(help, i);
+		if ('\0' != help->options.node_start_char && 0 != i && 0 != appendToAdvancedHelpBuffer(&subtree, &(help->options.node_start_char), 1)) {
+			free(subtree.data);
+			return;
+		}
+		if (0 != appendToAdvancedHelpBuffer(&subtree, node->text, node->len) || 0 != appendToAdvancedHelpBuffer(&subtree, "\n", 1)) {
+			free(subtree.data);
+			return;
+		}
+		i++;
+	} while (i < help->node_count && 0 != ADVANCED_HELP_NODE(help, i).level);
+
+	const size_t first_path[] = { 0 };
+	const size_t second_path[] = { 1 };
+	int error = insertAdvancedHelpSubtree(help_ptr, first_path, 1, subtree.data);
+	free(subtree.data);
+	if (0 != error) {
+		return;	// Not a well-formed subtree, or out of memory
+	}
+	FUZZ_CHECK(0 == deleteAdvancedHelpSubtree(help_ptr, second_path, 1), "deleteAdvancedHelpSubtree() failed on a copied subtree");
+
+	if ('\0' != keyword[0]) {
+		char* result = getAdvancedHelpForKeyword(keyword, help_ptr);
+		FUZZ_CHECK(NULL == result || 0 == strcmp(expected, result) || 0 == strcmp(ADVANCED_HELP_NOMEM_ERROR, result), "edited help differs from the reference");
+		free(result);
+	}
+
+	// The text of an edited help is joined from its nodes, and it must give back the same nodes when loaded again
+	char* joined_text = getAdvancedHelpForKeyword("", help_ptr);
+	void* joined_ptr = NULL;
+	if (NULL != joined_text && 0 != strcmp(ADVANCED_HELP_NOMEM_ERROR, joined_text)) {
+		checkFormatter("", help_ptr, joined_text, ADVANCED_HELP_STATUS_OK, joined_text);
+	}
+	if (NULL != joined_text && 0 != strcmp(ADVANCED_HELP_NOMEM_ERROR, joined_text) && 0 == initAdvancedHelpFromText(joined_text, &(help->options), &joined_ptr)) {
+		const AdvancedHelp* joined = (const AdvancedHelp*)joined_ptr;
+		FUZZ_CHECK(joined->node_count == help->node_count, "edited help text has a different number of nodes");
+		for (i = 0; i < help->node_count; i++) {
+			const AdvancedHelpNodeRef* node = &ADVANCED_HELP_NODE(help, i);
+			const AdvancedHelpNodeRef* joined_node = &ADVANCED_HELP_NODE(joined, i);
+			FUZZ_CHECK(joined_node->level == node->level && joined_node->len == node->len && 0 == memcmp(joined_node->text, node->text, node->len), "edited help text has different nodes");
+		}
+		freeAdvancedHelp(&joined_ptr);
+	}
+	free(joined_text);
+}
+
+// Every byte is widened to its own WCHAR, so the WCHAR result must be the widened result of the reference
+void checkWide(_In_ const char* keyword, _In_ const char* help_text, _In_opt_ const AdvancedHelpOptions* options, _In_ const char* expected) {
+	WCHAR* keyword_w = widenFuzzText(keyword);
+	WCHAR* help_text_w = widenFuzzText(help_text);
+	WCHAR* expected_w = widenFuzzText(expected);
+	void* help_ptr = NULL;
+	if (NULL != keyword_w && NULL != help_text_w && NULL != expected_w && 0 == initAdvancedHelpFromTextW(help_text_w, options, &help_ptr)) {
+		WCHAR* result = getAdvancedHelpForKeywordW(keyword_w, help_ptr);
+		FUZZ_CHECK(NULL == result || 0 == wcscmp(expected_w, result) || 0 == wcscmp(WTEXT(ADVANCED_HELP_NOMEM_ERROR), result), "getAdvancedHelpForKeywordW() differs from the reference");
+		free(result);
+		freeAdvancedHelpW(&help_ptr);
+	}
+	free(keyword_w);
+	free(help_text_w);
+	free(expected_w);
+}
+
+WCHAR* widenFuzzText(_In_ const char* text) {
+	size_t len = strlen(text);
+	WCHAR* text_w = (WCHAR*)malloc(sizeof(WCHAR) * (len + 1));
+	if (NULL != text_w) {
+		for (size_t i = 0; i <= len; i++) {
+			text_w[i] = (WCHAR)(unsigned char)text[i];
+		}
+	}
+	return text_w;
+}
+
+// Null-terminated copy of the input, cut at the first '\0'
+char* copyFuzzText(_In_reads_(size) const uint8_t* data, _In_ size_t size) {
+	const uint8_t* end = (const uint8_t*)memchr(data, '\0', size);
+	size_t len = (NULL != end) ? (size_t)(end - data) : size;
+	char* text = (char*)malloc(len + 1);
+	if (NULL != text) {
+		memcpy(text, data, len);
+		text[len] = '\0';
+	}
+	return text;
+}
+
+// Creates the temp file the first time (in $TMPDIR, or /tmp), to be removed at exit. Returns NULL if it could not be created
+const char* getFuzzSnapshotFilename() {
+	if ('\0' != fuzz_snapshot_filename[0]) {
+		return fuzz_snapshot_filename;
+	}
+	const char* tmp_dir = getenv("TMPDIR");
+	if (NULL == tmp_dir || '\0' == tmp_dir[0]) {
+		tmp_dir = "/tmp";
+	}
+	char filename[FUZZ_SNAPSHOT_FILENAME_SIZE];
+	int len = snprintf(filename, sizeof(filename), "%s/advanced_help_fuzz_XXXXXX", tmp_dir);
+	if (len < 0 || (size_t)len >= sizeof(filename)) {
+		return NULL;
+	}
+	int fd = mkstemp(filename);
+	if (fd < 0) {
+		return NULL;
+	}
+	close(fd);
+	strcpy_s(fuzz_snapshot_filename, sizeof(fuzz_snapshot_filename), filename);
+	atexit(removeFuzzSnapshotFile);
+	return fuzz_snapshot_filename;
+}
+
+void removeFuzzSnapshotFile() {
+	remove(fuzz_snapshot_filename);
+}
+
+#ifndef ADVANCED_HELP_FUZZ_LIBFUZZER
+// AFL or replay: runs every file given as argument, or stdin if there are none
+int main(int argc, char** argv) {
+	for (int i = (argc > 1) ? 1 : 0; i < argc; i++) {
+		FILE* fp = (argc > 1) ? fopen(argv[i], "rb") : stdin;
+		if (NULL == fp) {
+			fprintf(stderr, "advanced_help_fuzz: can not open %s\n", argv[i]);
+			return 1;
+		}
+
+		AdvancedHelpBuffer input = { 0 };
+		char chunk[4096];
+		size_t read_len = 0;
+		while (0 != (read_len = fread(chunk, 1, sizeof(chunk), fp))) {
+			if (0 != appendToAdvancedHelpBuffer(&input, chunk, read_len)) {
+				return 1;
+			}
+		}
+		if (stdin != fp) {
+			fclose(fp);
+		}
+		LLVMFuzzerTestOneInput((const uint8_t*)input.data, input.len);
+		free(input.data);
+	}
+	return 0;
+}
+#endif
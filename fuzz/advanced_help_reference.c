@@ -0,0 +1,221 @@
+
+/////   INCLUDES   /////
+
+#include "advanced_help_reference.h"
+
+#include <stdint.h>
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+char* getReferenceLineNode(_In_ char* new_line, _In_opt_ char* current_node, _In_ char node_start_char);
+size_t getReferenceNodeLevel(_In_ const char* current_node, _In_ char node_level_char);
+int growReferenceNodeStack(_Inout_ char*** current_nodes, _Inout_ bool** current_nodes_already_included, _Inout_ size_t* size, _In_ size_t min_size);
+char* copyReferenceMessage(_In_ const char* message);
+
+
+
+
+/////   FUNCTION IMPLEMENTATIONS   /////
+
+// Same algorithm as the original getAdvancedHelpForKeyword(), with the format taken from options instead of the defines. Differences:
+//    - A node at level max_node_level or deeper is a format error (the original wrote past its arrays). If max_node_level is 0 there is
+//      no limit, and the arrays grow with the deepest node found
+//    - The copy of the help text is freed (the original leaked it)
+// The returned pointer must be freed by function caller
+char* getReferenceHelpForKeyword(_In_ const char* keyword, _In_ const char* help_text, _In_ const AdvancedHelpOptions* options) {
+	const size_t max_node_level = options->max_node_level;
+	const size_t no_forced_include = (0 != max_node_level) ? max_node_level : SIZE_MAX;
+	size_t current_nodes_size = (0 != max_node_level) ? max_node_level : 1;
+	char* help_to_show = NULL;
+	char* full_help_text = NULL;
+	char** current_nodes = (char**)calloc(current_nodes_size, sizeof(char*));
+	bool* current_nodes_already_included = (bool*)calloc(current_nodes_size, sizeof(bool));
+	const char* message = NULL;
+
+	if (NULL == current_nodes || NULL == current_nodes_already_included) {
+		message = ADVANCED_HELP_NOMEM_ERROR;
+		goto REFERENCE_END_LABEL;
+	}
+
+	full_help_text = (char*)malloc(strlen(help_text) + 1);
+	if (NULL == full_help_text) {
+		message = ADVANCED_HELP_NOMEM_ERROR;
+		goto REFERENCE_END_LABEL;
+	}
+	strcpy_s(full_help_text, strlen(help_text) + 1, help_text);
+
+	if (0 == strcmp("", keyword)) {
+		help_to_show = full_help_text;
+		full_help_text = NULL;
+		goto REFERENCE_END_LABEL;
+	}
+
+	// Nodes are the same as lines, but without the node start char if needed. No memory is allocated for lines nor nodes
+	char* line = NULL;
+	char* current_node = NULL;
+	char* new_node = NULL;
+	size_t current_node_level = 0;
+	size_t forced_include_min_level = no_forced_include;
+
+	// Process all the help iteratively line by line. When there are no more tokens, line and new_node become NULL,
+	// so the last node is processed and then current_node becomes NULL too, which exits the loop
+	char* strtok_ctx = NULL;
+	do {
+		if (NULL == line) {
+			line = strtok_s(full_help_text, "\n", &strtok_ctx);
+		} else {
+			line = strtok_s(NULL, "\n", &strtok_ctx);
+		}
+		new_node = getReferenceLineNode(line, current_node, options->node_start_char);
+
+		// First iteration
+		if (NULL == current_node) {
+			current_node = new_node;
+			continue;
+		}
+		// More lines may fuse into the same node
+		if (new_node == current_node) {
+			continue;
+		}
+
+		// Process current node (already complete with all its lines)
+		current_node_level = getReferenceNodeLevel(current_node, options->node_level_char);
+		if (0 != max_node_level && current_node_level >= max_node_level) {
+			message = ADVANCED_HELP_FORMAT_ERROR;
+			goto REFERENCE_END_LABEL;
+		}
+		if (current_node_level >= current_nodes_size && 0 != growReferenceNodeStack(&current_nodes, &current_nodes_already_included, &current_nodes_size, current_node_level + 1)) {
+			message = ADVANCED_HELP_NOMEM_ERROR;
+			goto REFERENCE_END_LABEL;
+		}
+
+		// Check that nodes do not skip levels
+		for (size_t i = 0; i < current_node_level; i++) {
+			if (NULL == current_nodes[i]) {
+				message = ADVANCED_HELP_FORMAT_ERROR;
+				goto REFERENCE_END_LABEL;
+			}
+		}
+
+		// Assign current node and clear subnodes
+		current_nodes[current_node_level] = current_node;
+		current_nodes_already_included[current_node_level] = false;
+		for (size_t i = current_node_level + 1; i < current_nodes_size; i++) {
+			if (NULL == current_nodes[i]) {
+				break;
+			}
+			current_nodes[i] = NULL;
+			current_nodes_already_included[i] = false;
+		}
+
+		// Check if this node is forced to be added (due to parent node included the keyword)
+		if (forced_include_min_level < current_node_level) {
+			if ((0 != strAppendRealloc(&help_to_show, current_node)) || (0 != strAppendRealloc(&help_to_show, "\n"))) {
+				message = ADVANCED_HELP_NOMEM_ERROR;
+				goto REFERENCE_END_LABEL;
+			}
+		} else {
+			forced_include_min_level = no_forced_include;
+
+			if (NULL != strstr(current_node, keyword)) {
+				// Include parent nodes (and the current one) if not already included
+				for (size_t i = 0; i < current_node_level + 1; i++) {
+					if (!current_nodes_already_included[i]) {
+						if ((0 != strAppendRealloc(&help_to_show, current_nodes[i])) || (0 != strAppendRealloc(&help_to_show, "\n"))) {
+							message = ADVANCED_HELP_NOMEM_ERROR;
+							goto REFERENCE_END_LABEL;
+						}
+						current_nodes_already_included[i] = true;
+					}
+				}
+
+				// Force include everything below this level
+				forced_include_min_level = current_node_level;
+			}
+		}
+
+		current_node = new_node;
+	} while (NULL != current_node);
+
+	if (NULL == help_to_show) {
+		message = ADVANCED_HELP_KEYWORD_NOT_FOUND_INFO;
+	}
+
+REFERENCE_END_LABEL:
+	free(current_nodes);
+	free(current_nodes_already_included);
+	free(full_help_text);
+	if (NULL != message) {
+		free(help_to_show);
+		help_to_show = copyReferenceMessage(message);
+	}
+	return help_to_show;
+}
+
+char* getReferenceLineNode(_In_ char* new_line, _In_opt_ char* current_node, _In_ char node_start_char) {
+	if (NULL == new_line) {
+		return NULL;
+	}
+	if (NULL == current_node) {
+		return new_line;
+	}
+
+	if ('\0' == node_start_char) {
+		return new_line;	// New line is always a new node
+	} else if (new_line[0] == node_start_char) {
+		return &(new_line[1]);	// New line is a new node, but special character is removed
+	} else {
+		// New line is part of the last node. Restore the removed '\n' (can be several due to strtok behaviour) and return the same node again
+		size_t i = strlen(current_node);
+		while ('\0' == current_node[i]) {
+			current_node[i] = '\n';
+			i++;
+		}
+		return current_node;
+	}
+}
+
+size_t getReferenceNodeLevel(_In_ const char* current_node, _In_ char node_level_char) {
+	size_t current_node_level = 0;
+	for (size_t i = 0; '\0' != current_node[i]; i++) {
+		if (node_level_char == current_node[i]) {
+			current_node_level++;
+		}
+	}
+	return current_node_level;
+}
+
+// Only used without max_node_level. The new levels are empty. Returns 0 on success, -1 if there is not enough memory
+int growReferenceNodeStack(_Inout_ char*** current_nodes, _Inout_ bool** current_nodes_already_included, _Inout_ size_t* size, _In_ size_t min_size) {
+	size_t new_size = *size;
+	while (new_size < min_size) {
+		new_size *= 2;
+	}
+	char** new_nodes = (char**)realloc(*current_nodes, new_size * sizeof(char*));
+	if (NULL == new_nodes) {
+		return -1;
+	}
+	*current_nodes = new_nodes;
+	bool* new_already_included = (bool*)realloc(*current_nodes_already_included, new_size * sizeof(bool));
+	if (NULL == new_already_included) {
+		return -1;
+	}
+	*current_nodes_already_included = new_already_included;
+	for (size_t i = *size; i < new_size; i++) {
+		new_nodes[i] = NULL;
+		new_already_included[i] = false;
+	}
+	*size = new_size;
+	return 0;
+}
+
+char* copyReferenceMessage(_In_ const char* message) {
+	char* copy = (char*)malloc(strlen(message) + 1);
+	if (NULL != copy) {
+		strcpy_s(copy, strlen(message) + 1, message);
+	}
+	return copy;
+}
@@ -0,0 +1,29 @@
+#ifndef ADVANCED_HELP_REFERENCE_H
+#define ADVANCED_HELP_REFERENCE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+	/////   INCLUDES   /////
+#include "advanced_help.h"
+
+
+
+
+
+/////   FUNCTION DEFINITIONS   /////
+
+	// Frozen copy of the original line-by-line implementation of getAdvancedHelpForKeyword(), used as the oracle of the fuzz harness.
+	// It works straight on the help text (no node table) and must NOT be optimized nor follow the changes of the library:
+	// any difference with the library is a bug in the library unless the behaviour was changed on purpose (then update both).
+
+	char* getReferenceHelpForKeyword(_In_ const char* keyword, _In_ const char* help_text, _In_ const AdvancedHelpOptions* options);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADVANCED_HELP_REFERENCE_H
@@ -0,0 +1,278 @@
+#ifndef ADVANCED_HELP_FUZZ_COMPAT_WINDOWS_H
+#define ADVANCED_HELP_FUZZ_COMPAT_WINDOWS_H
+
+// Stand-in for <Windows.h> so the library and the fuzz harness can be built on Linux (with -I fuzz/compat).
+// Only what the library uses is defined. Not meant for anything but fuzzing: the WCHAR file functions always fail.
+
+
+	/////   INCLUDES   /////
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+
+
+
+
+
+/////   DEFINES   /////
+
+// SAL annotations
+#define _In_
+#define _In_opt_
+#define _Inout_
+#define _Inout_opt_
+#define _Out_
+#define _Out_opt_
+#define _In_reads_(size)
+#define _In_reads_opt_(size)
+#define _Out_writes_(size)
+#define _Out_writes_opt_(size)
+
+#define __forceinline inline __attribute__((always_inline))
+#define __declspec(attribute) ADVANCED_HELP_COMPAT_DECLSPEC_##attribute
+#define ADVANCED_HELP_COMPAT_DECLSPEC_thread __thread
+
+#define strtok_s strtok_r
+#define wcstok_s wcstok
+
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define GENERIC_READ 0x80000000
+#define FILE_SHARE_READ 0x00000001
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x00000080
+#define PAGE_READONLY 0x02
+#define FILE_MAP_READ 0x0004
+
+#define SRWLOCK_INIT PTHREAD_RWLOCK_INITIALIZER
+#define AcquireSRWLockShared pthread_rwlock_rdlock
+#define ReleaseSRWLockShared pthread_rwlock_unlock
+#define AcquireSRWLockExclusive pthread_rwlock_wrlock
+#define ReleaseSRWLockExclusive pthread_rwlock_unlock
+
+#define TRUE 1
+#define FALSE 0
+#define VOID void
+#define CALLBACK
+#define NTAPI
+#define InterlockedExchange(target, value) __atomic_exchange_n((target), (value), __ATOMIC_SEQ_CST)
+#define InterlockedExchangePointer(target, value) __atomic_exchange_n((target), (value), __ATOMIC_SEQ_CST)
+#define ReadAcquire(source) __atomic_load_n((source), __ATOMIC_ACQUIRE)
+#define ReadPointerAcquire(source) __atomic_load_n((source), __ATOMIC_ACQUIRE)
+#define FLS_OUT_OF_INDEXES ((DWORD)0xFFFFFFFF)
+
+
+
+/////   TYPES   /////
+
+	typedef wchar_t WCHAR;
+	typedef int errno_t;
+	typedef int BOOL;
+	typedef unsigned long DWORD;
+	typedef void* HANDLE;
+	typedef pthread_rwlock_t SRWLOCK;
+	typedef long LONG;
+	typedef void* PVOID;
+	typedef void* PTP_CALLBACK_INSTANCE;
+	typedef void* PTP_CALLBACK_ENVIRON;
+	typedef struct AdvancedHelpCompatWork* PTP_WORK;
+	typedef VOID (*PTP_WORK_CALLBACK)(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work);
+	typedef VOID (*PFLS_CALLBACK_FUNCTION)(PVOID data);
+	typedef union LARGE_INTEGER {
+		long long QuadPart;
+	} LARGE_INTEGER;
+
+	// Files are file descriptors + 1 (so 0 is never a valid handle). A mapping keeps its view, which is unmapped when the mapping is closed
+	typedef struct AdvancedHelpCompatMapping {
+		size_t size;
+		void* view;
+	} AdvancedHelpCompatMapping;
+
+	// Thread pool work: every submit gets a thread of its own, joined when waiting for the work (only one submit at a time is supported)
+	typedef struct AdvancedHelpCompatWork {
+		PTP_WORK_CALLBACK callback;
+		PVOID context;
+		pthread_t thread;
+		bool running;
+	} AdvancedHelpCompatWork;
+
+
+
+/////   FUNCTION IMPLEMENTATIONS   /////
+
+	static inline errno_t strcpy_s(char* dest, size_t dest_size, const char* src) {
+		if (strlen(src) >= dest_size) {
+			abort();	// The MSVC version would call the invalid parameter handler
+		}
+		strcpy(dest, src);
+		return 0;
+	}
+
+	static inline errno_t wcscpy_s(WCHAR* dest, size_t dest_size, const WCHAR* src) {
+		if (wcslen(src) >= dest_size) {
+			abort();
+		}
+		wcscpy(dest, src);
+		return 0;
+	}
+
+	static inline errno_t fopen_s(FILE** fp, const char* filename, const char* mode) {
+		*fp = fopen(filename, mode);
+		return (NULL != *fp) ? 0 : errno;
+	}
+
+	static inline errno_t _wfopen_s(FILE** fp, const WCHAR* filename, const WCHAR* mode) {
+		(void)filename;
+		(void)mode;
+		*fp = NULL;
+		return ENOENT;
+	}
+
+	static inline size_t fread_s(void* buffer, size_t buffer_size, size_t element_size, size_t count, FILE* fp) {
+		if (element_size * count > buffer_size) {
+			abort();
+		}
+		return fread(buffer, element_size, count, fp);
+	}
+
+	static inline HANDLE CreateFileA(const char* filename, DWORD access, DWORD share_mode, void* security, DWORD disposition, DWORD flags, HANDLE template_file) {
+		(void)access;
+		(void)share_mode;
+		(void)security;
+		(void)disposition;
+		(void)flags;
+		(void)template_file;
+		int fd = open(filename, O_RDONLY);
+		return (fd < 0) ? INVALID_HANDLE_VALUE : (HANDLE)(intptr_t)(fd + 1);
+	}
+
+	static inline BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* file_size) {
+		struct stat file_stat;
+		if (0 != fstat((int)(intptr_t)file - 1, &file_stat)) {
+			return 0;
+		}
+		file_size->QuadPart = file_stat.st_size;
+		return 1;
+	}
+
+	static inline HANDLE CreateFileMappingA(HANDLE file, void* security, DWORD protection, DWORD size_high, DWORD size_low, const char* name) {
+		(void)security;
+		(void)protection;
+		(void)size_high;
+		(void)size_low;
+		(void)name;
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || 0 == file_size.QuadPart) {
+			return NULL;
+		}
+		AdvancedHelpCompatMapping* mapping = (AdvancedHelpCompatMapping*)calloc(1, sizeof(AdvancedHelpCompatMapping));
+		if (NULL == mapping) {
+			return NULL;
+		}
+		mapping->size = (size_t)file_size.QuadPart;
+		mapping->view = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, (int)(intptr_t)file - 1, 0);
+		if (MAP_FAILED == mapping->view) {
+			free(mapping);
+			return NULL;
+		}
+		return mapping;
+	}
+
+	static inline void* MapViewOfFile(HANDLE mapping, DWORD access, DWORD offset_high, DWORD offset_low, size_t size) {
+		(void)access;
+		(void)offset_high;
+		(void)offset_low;
+		(void)size;
+		return ((AdvancedHelpCompatMapping*)mapping)->view;
+	}
+
+	static inline BOOL UnmapViewOfFile(const void* view) {
+		(void)view;
+		return 1;
+	}
+
+	// Only for the handles created above: mappings are heap pointers, files are small numbers
+	static inline BOOL CloseHandle(HANDLE handle) {
+		if ((intptr_t)handle > 0 && (intptr_t)handle <= 0x10000) {
+			return 0 == close((int)(intptr_t)handle - 1);
+		}
+		AdvancedHelpCompatMapping* mapping = (AdvancedHelpCompatMapping*)handle;
+		munmap(mapping->view, mapping->size);
+		free(mapping);
+		return 1;
+	}
+
+	// Events are eventfd-like file descriptors (handles from CreateFileA-style fd + 1): setting one writes a count of 1
+	static inline BOOL SetEvent(HANDLE event) {
+		uint64_t count = 1;
+		return sizeof(count) == write((int)(intptr_t)event - 1, &count, sizeof(count));
+	}
+
+	static inline void* runAdvancedHelpCompatWork(void* work_ptr) {
+		PTP_WORK work = (PTP_WORK)work_ptr;
+		work->callback(NULL, work->context, work);
+		return NULL;
+	}
+
+	static inline PTP_WORK CreateThreadpoolWork(PTP_WORK_CALLBACK callback, PVOID context, PTP_CALLBACK_ENVIRON environment) {
+		(void)environment;
+		PTP_WORK work = (PTP_WORK)calloc(1, sizeof(AdvancedHelpCompatWork));
+		if (NULL != work) {
+			work->callback = callback;
+			work->context = context;
+		}
+		return work;
+	}
+
+	static inline VOID SubmitThreadpoolWork(PTP_WORK work) {
+		if (0 != pthread_create(&(work->thread), NULL, runAdvancedHelpCompatWork, work)) {
+			abort();	// The real one can't fail either
+		}
+		work->running = true;
+	}
+
+	static inline VOID WaitForThreadpoolWorkCallbacks(PTP_WORK work, BOOL cancel_pending) {
+		(void)cancel_pending;
+		if (work->running && !pthread_equal(work->thread, pthread_self())) {
+			pthread_join(work->thread, NULL);
+			work->running = false;
+		}
+	}
+
+	static inline VOID CloseThreadpoolWork(PTP_WORK work) {
+		free(work);
+	}
+
+	// FLS slots are pthread keys: the callback runs when a thread that set a value exits
+	static inline DWORD FlsAlloc(PFLS_CALLBACK_FUNCTION callback) {
+		pthread_key_t key;
+		return (0 == pthread_key_create(&key, callback)) ? (DWORD)key : FLS_OUT_OF_INDEXES;
+	}
+
+	static inline BOOL FlsSetValue(DWORD index, PVOID data) {
+		return 0 == pthread_setspecific((pthread_key_t)index, data);
+	}
+
+	static inline int QueryPerformanceCounter(LARGE_INTEGER* counter) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		counter->QuadPart = now.tv_sec * 1000000000LL + now.tv_nsec;
+		return 1;
+	}
+
+	static inline int QueryPerformanceFrequency(LARGE_INTEGER* frequency) {
+		frequency->QuadPart = 1000000000LL;
+		return 1;
+	}
+
+
+#endif // ADVANCED_HELP_FUZZ_COMPAT_WINDOWS_H
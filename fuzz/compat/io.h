@@ -0,0 +1,11 @@
+#ifndef ADVANCED_HELP_FUZZ_COMPAT_IO_H
+#define ADVANCED_HELP_FUZZ_COMPAT_IO_H
+
+// Stand-in for <io.h> (see Windows.h)
+
+#include <unistd.h>
+
+#define _write(fd, buffer, count) write(fd, buffer, count)
+
+
+#endif // ADVANCED_HELP_FUZZ_COMPAT_IO_H